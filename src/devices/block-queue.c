@@ -0,0 +1,266 @@
+#include "devices/block-queue.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Maximum number of sectors in a merged request. */
+#define MERGE_MAX_SECTORS 256
+
+/* Time, in timer ticks, that a read or a write may wait in the
+   queue before it is dispatched ahead of elevator order.  Reads
+   usually have a thread waiting on them, so they get the shorter
+   deadline. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (TIMER_FREQ * 5)
+
+static thread_func dispatcher NO_RETURN;
+
+/* Initializes Q and starts its dispatcher thread, named NAME,
+   which carries out requests by calling TRANSFER. */
+void
+block_queue_init (struct block_queue *q, const char *name,
+                  block_transfer_func *transfer)
+{
+  lock_init (&q->lock);
+  cond_init (&q->nonempty);
+  list_init (&q->sorted);
+  list_init (&q->fifo);
+  q->head_block = NULL;
+  q->head_sector = 0;
+  q->transfer = transfer;
+  thread_create (name, PRI_MAX, dispatcher, q);
+}
+
+/* Returns true if request A comes before request B in elevator
+   order, that is, by device and then by first sector. */
+static bool
+position_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  if (a->block != b->block)
+    return a->block < b->block;
+  return a->q_sector < b->q_sector;
+}
+
+/* Tries to merge REQ into a pending request in Q for the
+   adjacent sectors in the same direction on the same device.
+   Returns true if successful. */
+static bool
+try_merge (struct block_queue *q, struct block_request *req)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&q->sorted); e != list_end (&q->sorted);
+       e = list_next (e))
+    {
+      struct block_request *p = list_entry (e, struct block_request, elem);
+      bool back, front;
+
+      if (p->block != req->block || p->write != req->write
+          || p->q_cnt + req->cnt > MERGE_MAX_SECTORS)
+        continue;
+
+      back = p->q_sector + p->q_cnt == req->sector;
+      front = req->sector + req->cnt == p->q_sector;
+      if (!back && !front)
+        continue;
+
+      /* Merged requests are kept in sector order, so that
+         dispatch can walk them front to back. */
+      if (back)
+        list_push_back (&p->merged, &req->elem);
+      else
+        {
+          list_push_front (&p->merged, &req->elem);
+          p->q_sector = req->sector;
+
+          /* Moving P's start may move it in elevator order. */
+          list_remove (&p->elem);
+          list_insert_ordered (&q->sorted, &p->elem, position_less, NULL);
+        }
+      p->q_cnt += req->cnt;
+      if (req->deadline < p->deadline)
+        p->deadline = req->deadline;
+      return true;
+    }
+  return false;
+}
+
+/* Adds REQ to Q, merging it with a pending request if possible.
+   REQ's DRIVER_DATA must already be set. */
+void
+block_queue_add (struct block_queue *q, struct block_request *req)
+{
+  req->q_sector = req->sector;
+  req->q_cnt = req->cnt;
+  req->deadline = timer_ticks () + (req->write ? WRITE_DEADLINE
+                                    : READ_DEADLINE);
+  list_init (&req->merged);
+
+  lock_acquire (&q->lock);
+  if (!try_merge (q, req))
+    {
+      list_insert_ordered (&q->sorted, &req->elem, position_less, NULL);
+      list_push_back (&q->fifo, &req->fifo_elem);
+      cond_signal (&q->nonempty, &q->lock);
+    }
+  lock_release (&q->lock);
+}
+
+/* Removes and returns the next request to dispatch from Q, which
+   must not be empty: the oldest request if its deadline has
+   passed, otherwise the first request at or past the position
+   of the last dispatch, wrapping around to the lowest position
+   at the end (C-LOOK). */
+static struct block_request *
+next_request (struct block_queue *q)
+{
+  struct block_request *req;
+  struct list_elem *e;
+
+  ASSERT (!list_empty (&q->sorted));
+
+  req = list_entry (list_front (&q->fifo), struct block_request, fifo_elem);
+  if (req->deadline > timer_ticks ())
+    {
+      req = NULL;
+      for (e = list_begin (&q->sorted); e != list_end (&q->sorted);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                elem);
+          if (r->block > q->head_block
+              || (r->block == q->head_block
+                  && r->q_sector >= q->head_sector))
+            {
+              req = r;
+              break;
+            }
+        }
+      if (req == NULL)
+        req = list_entry (list_front (&q->sorted), struct block_request,
+                          elem);
+    }
+
+  list_remove (&req->elem);
+  list_remove (&req->fifo_elem);
+  q->head_block = req->block;
+  q->head_sector = req->q_sector + req->q_cnt;
+  return req;
+}
+
+/* Completes REQ and every request merged into it. */
+static void
+complete_all (struct block_request *req)
+{
+  while (!list_empty (&req->merged))
+    block_complete (list_entry (list_pop_front (&req->merged),
+                                struct block_request, elem));
+  block_complete (req);
+}
+
+/* Carries out REQ, together with the requests merged into it, as
+   a single transfer through Q's driver.  If the buffers of the
+   merged requests are not contiguous in memory, the data goes
+   through a bounce buffer, or if none is available, the
+   requests are carried out one at a time. */
+static void
+dispatch (struct block_queue *q, struct block_request *req)
+{
+  struct block_request *first, *r;
+  struct list_elem *e;
+  uint8_t *buffer, *bounce = NULL;
+  bool contiguous = true;
+  uint64_t now;
+
+  /* Merged requests in sector order: front merges, REQ, then
+     back merges.  Put REQ in its place. */
+  for (e = list_begin (&req->merged); e != list_end (&req->merged);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector > req->sector)
+      break;
+  list_insert (e, &req->elem);
+
+  first = list_entry (list_front (&req->merged), struct block_request, elem);
+  buffer = first->buffer;
+  now = timer_cycles ();
+  for (e = list_begin (&req->merged); e != list_end (&req->merged);
+       e = list_next (e))
+    {
+      r = list_entry (e, struct block_request, elem);
+      r->dispatch_time = now;
+      if ((uint8_t *) r->buffer
+          != buffer + (r->sector - req->q_sector) * BLOCK_SECTOR_SIZE)
+        contiguous = false;
+    }
+
+  if (!contiguous)
+    {
+      bounce = malloc (req->q_cnt * BLOCK_SECTOR_SIZE);
+      if (bounce == NULL)
+        {
+          /* Fall back to one transfer per request. */
+          for (e = list_begin (&req->merged); e != list_end (&req->merged);
+               e = list_next (e))
+            {
+              r = list_entry (e, struct block_request, elem);
+              q->transfer (r, r->sector, r->cnt, r->buffer, r->write);
+            }
+          goto done;
+        }
+      buffer = bounce;
+      if (req->write)
+        for (e = list_begin (&req->merged); e != list_end (&req->merged);
+             e = list_next (e))
+          {
+            r = list_entry (e, struct block_request, elem);
+            memcpy (bounce + (r->sector - req->q_sector) * BLOCK_SECTOR_SIZE,
+                    r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          }
+    }
+
+  q->transfer (req, req->q_sector, req->q_cnt, buffer, req->write);
+
+  if (bounce != NULL)
+    {
+      if (!req->write)
+        for (e = list_begin (&req->merged); e != list_end (&req->merged);
+             e = list_next (e))
+          {
+            r = list_entry (e, struct block_request, elem);
+            memcpy (r->buffer,
+                    bounce + (r->sector - req->q_sector) * BLOCK_SECTOR_SIZE,
+                    r->cnt * BLOCK_SECTOR_SIZE);
+          }
+      free (bounce);
+    }
+
+ done:
+  list_remove (&req->elem);
+  complete_all (req);
+}
+
+/* Dispatcher thread for block queue Q_. */
+static void
+dispatcher (void *q_)
+{
+  struct block_queue *q = q_;
+
+  for (;;)
+    {
+      struct block_request *req;
+
+      lock_acquire (&q->lock);
+      while (list_empty (&q->sorted))
+        cond_wait (&q->nonempty, &q->lock);
+      req = next_request (q);
+      lock_release (&q->lock);
+
+      dispatch (q, req);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef DEVICES_BLOCK_QUEUE_H
+#define DEVICES_BLOCK_QUEUE_H
+
+#include <list.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+
+/* Driver routine that performs one transfer of CNT sectors
+   starting at SECTOR between BUFFER and the device that REQ was
+   submitted to.  Called from the queue's thread. */
+typedef void block_transfer_func (struct block_request *req,
+                                  block_sector_t sector, block_sector_t cnt,
+                                  void *buffer, bool write);
+
+/* A queue of pending block requests served by its own thread.
+
+   Requests are kept sorted by device and sector and dispatched
+   in one-way elevator (C-LOOK) order, except that a request that
+   has waited past its deadline is dispatched first.  A request
+   for sectors adjacent to a pending request in the same
+   direction on the same device is merged into it, so that both
+   go to the driver as a single transfer. */
+struct block_queue
+  {
+    struct lock lock;                   /* Protects the members below. */
+    struct condition nonempty;          /* Signaled when a request arrives. */
+    struct list sorted;                 /* Pending requests, by position. */
+    struct list fifo;                   /* Pending requests, by arrival. */
+    struct block *head_block;           /* Device of the last dispatch. */
+    block_sector_t head_sector;         /* Sector after the last dispatch. */
+    block_transfer_func *transfer;      /* Driver transfer routine. */
+  };
+
+void block_queue_init (struct block_queue *, const char *name,
+                       block_transfer_func *);
+void block_queue_add (struct block_queue *, struct block_request *);
+
+#endif /* devices/block-queue.h */
@@ -3,7 +3,11 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* A block device. */
 struct block
@@ -19,6 +23,10 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long read_reqs;       /* Number of read requests. */
+    unsigned long long write_reqs;      /* Number of write requests. */
+    unsigned wait_hist[BLOCK_HIST_CNT]; /* Queue wait, by log2 cycles. */
+    unsigned service_hist[BLOCK_HIST_CNT]; /* Service time, likewise. */
   };
 
 /* List of all block devices. */
@@ -27,6 +35,29 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* A finished request, as recorded in the trace ring. */
+struct trace_event
+  {
+    uint64_t time;                      /* timer_cycles() at submission. */
+    uint32_t wait;                      /* Cycles spent queued. */
+    uint32_t service;                   /* Cycles spent in the driver. */
+    struct block *origin;               /* Device submitted to. */
+    struct block *block;                /* Device that carried it out. */
+    block_sector_t sector;              /* First sector on BLOCK. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    int tid;                            /* Submitting thread. */
+    bool write;                         /* Write (true) or read (false)? */
+  };
+
+/* Trace ring holding the last TRACE_SIZE requests, or a null
+   pointer if tracing is disabled.  TRACE_NEXT is the slot to
+   fill next and TRACE_CNT the number of requests ever recorded.
+   Protected by disabling interrupts. */
+static struct trace_event *trace;
+static size_t trace_size;
+static size_t trace_next;
+static unsigned long long trace_cnt;
+
 static struct block *list_elem_to_block (struct list_elem *);
 
 /* Returns a human-readable name for the given block device
@@ -113,6 +144,141 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Returns the log2 histogram bucket for an interval of CYCLES. */
+static unsigned
+hist_bucket (uint64_t cycles)
+{
+  unsigned bucket = 0;
+
+  while (cycles > 1 && bucket < BLOCK_HIST_CNT - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Adds a request that waited WAIT cycles in BLOCK's queue and
+   then took SERVICE cycles to carry out to BLOCK's statistics. */
+static void
+record (struct block *block, bool write, uint64_t wait, uint64_t service)
+{
+  if (write)
+    block->write_reqs++;
+  else
+    block->read_reqs++;
+  block->wait_hist[hist_bucket (wait)]++;
+  block->service_hist[hist_bucket (service)]++;
+}
+
+/* Returns X, or UINT32_MAX if X does not fit in 32 bits. */
+static uint32_t
+clamp32 (uint64_t x)
+{
+  return x < UINT32_MAX ? x : UINT32_MAX;
+}
+
+/* Accounts for a just-finished transfer of the CNT sectors
+   starting at SECTOR on BLOCK, which was submitted to ORIGIN
+   (either BLOCK or a partition of it) by thread TID at time
+   SUBMIT and passed to the driver at time DISPATCH. */
+static void
+account (struct block *block, struct block *origin, block_sector_t sector,
+         block_sector_t cnt, bool write, int tid, uint64_t submit,
+         uint64_t dispatch)
+{
+  uint64_t now = timer_cycles ();
+  uint64_t wait, service;
+  enum intr_level old_level;
+
+  if (dispatch < submit)
+    dispatch = submit;
+  wait = dispatch - submit;
+  service = now - dispatch;
+
+  old_level = intr_disable ();
+  record (block, write, wait, service);
+  if (origin != block)
+    record (origin, write, wait, service);
+  if (trace != NULL)
+    {
+      struct trace_event *ev = &trace[trace_next];
+      ev->time = submit;
+      ev->wait = clamp32 (wait);
+      ev->service = clamp32 (service);
+      ev->origin = origin;
+      ev->block = block;
+      ev->sector = sector;
+      ev->cnt = cnt;
+      ev->tid = tid;
+      ev->write = write;
+      trace_next = (trace_next + 1) % trace_size;
+      trace_cnt++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFER by calling the driver's synchronous operations. */
+static void
+transfer_direct (struct block *block, block_sector_t sector,
+                 block_sector_t cnt, void *buffer_, bool write)
+{
+  uint8_t *buffer = buffer_;
+  block_sector_t i;
+
+  if (cnt == 1)
+    {
+      if (write)
+        block->ops->write (block->aux, sector, buffer);
+      else
+        block->ops->read (block->aux, sector, buffer);
+    }
+  else if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      transfer_direct (block, sector + i, 1, buffer + i * BLOCK_SECTOR_SIZE,
+                       write);
+}
+
+/* Completion callback that wakes up the thread waiting on
+   semaphore SEMA. */
+static void
+wake_waiter (struct block_request *req UNUSED, void *sema)
+{
+  sema_up (sema);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFER, returning when the transfer is complete.  Goes through
+   the device's request queue, if it has one. */
+static void
+transfer (struct block *block, block_sector_t sector, block_sector_t cnt,
+          void *buffer, bool write)
+{
+  if (block->ops->submit != NULL)
+    {
+      struct block_request req;
+      struct semaphore done;
+
+      sema_init (&done, 0);
+      block_request_init (&req, block, sector, cnt, buffer, write,
+                          wake_waiter, &done);
+      req.submit_time = timer_cycles ();
+      block->ops->submit (block->aux, &req);
+      sema_down (&done);
+    }
+  else
+    {
+      uint64_t start = timer_cycles ();
+      transfer_direct (block, sector, cnt, buffer, write);
+      account (block, block, sector, cnt, write, thread_tid (), start, start);
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -121,7 +287,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
+  transfer (block, sector, 1, buffer, false);
   block->read_cnt++;
 }
 
@@ -135,10 +301,125 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
+  transfer (block, sector, 1, (void *) buffer, true);
   block->write_cnt++;
 }
 
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  if (sector >= block->size || cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%"PRDSNu", "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
+/* Reads the CNT contiguous sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it transfer the whole run with
+   as few commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  transfer (block, sector, cnt, buffer, false);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT contiguous sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  transfer (block, sector, cnt, (void *) buffer, true);
+  block->write_cnt += cnt;
+}
+
+/* Initializes REQ as a request to transfer the CNT sectors
+   starting at SECTOR between BLOCK and BUFFER, writing if WRITE
+   is true and reading otherwise, and to call DONE with AUX when
+   finished. */
+void
+block_request_init (struct block_request *req, struct block *block,
+                    block_sector_t sector, block_sector_t cnt,
+                    void *buffer, bool write, block_done_func *done,
+                    void *aux)
+{
+  ASSERT (cnt > 0);
+  ASSERT (done != NULL);
+
+  req->block = block;
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->write = write;
+  req->done = done;
+  req->aux = aux;
+  req->driver_data = NULL;
+  req->origin = block;
+  req->tid = thread_tid ();
+  req->submit_time = req->dispatch_time = 0;
+}
+
+/* Starts carrying out REQ and returns, usually before the
+   transfer is done.  REQ's callback is invoked once it is.  If
+   BLOCK has no request queue, the transfer happens, and the
+   callback is invoked, before block_submit() returns. */
+void
+block_submit (struct block_request *req)
+{
+  struct block *block = req->block;
+
+  check_sectors (block, req->sector, req->cnt);
+  if (block == req->origin)
+    req->submit_time = timer_cycles ();
+  if (req->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += req->cnt;
+    }
+  else
+    block->read_cnt += req->cnt;
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, req);
+  else
+    {
+      req->dispatch_time = timer_cycles ();
+      transfer_direct (block, req->sector, req->cnt, req->buffer,
+                       req->write);
+      block_complete (req);
+    }
+}
+
+/* Called by a driver when it has carried out REQ.  Drivers that
+   queue requests should set REQ's dispatch_time to
+   timer_cycles() when they start carrying it out.  Accounts for
+   REQ and invokes its completion callback. */
+void
+block_complete (struct block_request *req)
+{
+  account (req->block, req->origin, req->sector, req->cnt, req->write,
+           req->tid, req->submit_time, req->dispatch_time);
+  req->done (req, req->aux);
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -160,7 +441,23 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints HIST, BLOCK's histogram of the given KIND, as a list of
+   "2^N:COUNT" pairs for its nonempty buckets. */
+static void
+print_histogram (struct block *block, const char *kind,
+                 const unsigned hist[BLOCK_HIST_CNT])
+{
+  unsigned i;
+
+  printf ("%s: %s cycles:", block->name, kind);
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (hist[i] != 0)
+      printf (" 2^%u:%u", i, hist[i]);
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, followed by the trace ring, if tracing is enabled. */
 void
 block_print_stats (void)
 {
@@ -174,8 +471,72 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->read_reqs + block->write_reqs == 0)
+            continue;
+          printf ("%s: %llu bytes read in %llu requests, "
+                  "%llu bytes written in %llu requests\n", block->name,
+                  block->read_cnt * BLOCK_SECTOR_SIZE, block->read_reqs,
+                  block->write_cnt * BLOCK_SECTOR_SIZE, block->write_reqs);
+          print_histogram (block, "queue wait", block->wait_hist);
+          print_histogram (block, "service time", block->service_hist);
         }
     }
+  block_print_trace ();
+}
+
+/* Enables the trace ring, making it remember the last SIZE
+   requests.  Does nothing if SIZE is 0. */
+void
+block_trace_init (size_t size)
+{
+  if (size == 0)
+    return;
+
+  trace = calloc (size, sizeof *trace);
+  if (trace == NULL)
+    {
+      printf ("block: not enough memory for %zu-entry trace\n", size);
+      return;
+    }
+  trace_size = size;
+}
+
+/* Prints the requests in the trace ring, oldest first, one per
+   line: submission time, device, direction, sector range on the
+   device that carried out the request, submitting thread, and
+   cycles spent queued and in the driver.  Does nothing if
+   tracing is disabled. */
+void
+block_print_trace (void)
+{
+  enum intr_level old_level;
+  unsigned long long cnt;
+  size_t i, n, first;
+
+  if (trace == NULL)
+    return;
+
+  old_level = intr_disable ();
+  cnt = trace_cnt;
+  n = cnt < trace_size ? cnt : trace_size;
+  first = (trace_next + trace_size - n) % trace_size;
+  intr_set_level (old_level);
+
+  printf ("Block trace: %llu requests, last %zu follow\n", cnt, n);
+  for (i = 0; i < n; i++)
+    {
+      struct trace_event ev;
+
+      old_level = intr_disable ();
+      ev = trace[(first + i) % trace_size];
+      intr_set_level (old_level);
+
+      printf ("%"PRIu64" %s %c %s:%"PRDSNu"+%"PRDSNu" tid %d "
+              "wait %"PRIu32" service %"PRIu32"\n",
+              ev.time, ev.origin->name, ev.write ? 'W' : 'R',
+              ev.block->name, ev.sector, ev.cnt, ev.tid,
+              ev.wait, ev.service);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -200,6 +561,10 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->read_reqs = 0;
+  block->write_reqs = 0;
+  memset (block->wait_hist, 0, sizeof block->wait_hist);
+  memset (block->service_hist, 0, sizeof block->service_hist);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +55,67 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
-/* Statistics. */
+/* Asynchronous requests. */
+
+struct block_request;
+typedef void block_done_func (struct block_request *, void *aux);
+
+/* A request to transfer CNT contiguous sectors starting at SECTOR
+   between BLOCK and BUFFER.  Initialize with block_request_init()
+   and pass to block_submit(); the request, and BUFFER, must stay
+   alive until DONE has been called with AUX.  DONE may be called
+   from another kernel thread, but never from an interrupt
+   handler. */
+struct block_request
+  {
+    struct block *block;                /* Device. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write (true) or read (false)? */
+    block_done_func *done;              /* Completion callback. */
+    void *aux;                          /* Passed to DONE. */
+
+    /* Owned by the block layer and drivers. */
+    void *driver_data;                  /* Driver's per-device data. */
+    struct list_elem elem;              /* Queue or merge list element. */
+    struct list_elem fifo_elem;         /* Queue arrival order element. */
+    struct list merged;                 /* Requests merged into this one. */
+    block_sector_t q_sector;            /* First sector, with merges. */
+    block_sector_t q_cnt;               /* Sector count, with merges. */
+    int64_t deadline;                   /* Dispatch by this timer tick. */
+
+    /* Owned by the block layer, for statistics. */
+    struct block *origin;               /* Device first submitted to. */
+    int tid;                            /* Submitting thread. */
+    uint64_t submit_time;               /* timer_cycles() at submission. */
+    uint64_t dispatch_time;             /* timer_cycles() at dispatch. */
+  };
+
+void block_request_init (struct block_request *, struct block *,
+                         block_sector_t sector, block_sector_t cnt,
+                         void *buffer, bool write,
+                         block_done_func *, void *aux);
+void block_submit (struct block_request *);
+void block_complete (struct block_request *);
+
+/* Statistics.
+
+   For each device, the block layer keeps log2 histograms, in CPU
+   cycles, of the time requests spend waiting in its queue and
+   of the time the driver takes to carry them out.  Optionally,
+   it also records the most recent requests in a trace ring. */
+#define BLOCK_HIST_CNT 40       /* Histogram buckets, up to 2**39. */
+void block_trace_init (size_t size);
 void block_print_stats (void);
+void block_print_trace (void);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,6 +123,21 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfers of CNT contiguous sectors.  Optional: if null,
+       the block layer issues CNT single-sector operations. */
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
+
+    /* Queues REQ, whose sectors have already been checked, and
+       arranges for block_complete() to be called on it once it
+       has been carried out.  Optional: if null, requests are
+       carried out synchronously by block_submit().  When set,
+       block_read() and block_write() and their multi-sector
+       forms also go through it. */
+    void (*submit) (void *aux, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -3,15 +3,26 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
+#include "devices/block-queue.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Where the PCI IDE controller supports bus-master DMA (as the
+   PIIX controllers emulated by QEMU and Bochs do), sectors are
+   transferred by DMA and the requesting thread sleeps until the
+   transfer completes.  Otherwise, or if a buffer is unsuitable
+   for DMA, sectors are moved by programmed I/O. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +45,21 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base from the PCI IDE controller's BAR4. */
+#define reg_bmcmd(CHANNEL) ((CHANNEL)->bm_base + 0)     /* Command. */
+#define reg_bmstatus(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bmprdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt raised (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +75,23 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors moved by one ATA command.  A sector
+   count register value of 0 means 256. */
+#define IDE_MAX_SECTORS 256
+
+/* Physical Region Descriptor, one entry in the scatter/gather
+   table that a bus master channel walks during a DMA transfer.
+   A region must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, even. */
+    uint16_t size;              /* Byte count, even; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +100,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool use_dma;               /* Transfer by bus-master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +116,11 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, one page. */
+
+    struct block_queue queue;   /* Requests for both devices. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +134,14 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static block_transfer_func ide_queue_transfer;
+
+static void init_dma (void);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, void *, bool write);
+
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -103,6 +159,7 @@ ide_init (void)
 {
   size_t chan_no;
 
+  init_dma ();
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +183,7 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      block_queue_init (&c->queue, c->name, ide_queue_transfer);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,12 +194,15 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->use_dma = false;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
       /* Reset hardware. */
+      if (c->bm_base != 0)
+        outb (reg_bmcmd (c), 0);
       reset_channel (c);
 
       /* Distinguish ATA hard disks from other devices. */
@@ -155,6 +216,39 @@ ide_init (void)
     }
 }
 
+/* Looks for a PCI IDE controller capable of bus-master DMA and,
+   if there is one, sets up each legacy channel that it drives
+   to use it. */
+static void
+init_dma (void) 
+{
+  struct pci_dev *pci;
+  uint32_t bar;
+  size_t chan_no;
+
+  pci = pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, NULL);
+  if (pci == NULL || !(pci->prog_if & 0x80))
+    return;
+  bar = pci_get_bar (pci, 4);
+  if (!(bar & 1))
+    return;
+  pci_enable_bus_master (pci);
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) 
+    {
+      struct channel *c = &channels[chan_no];
+
+      /* Channels in native-PCI mode do not use the legacy ports
+         and IRQs that the rest of this driver assumes. */
+      if (pci->prog_if & (1 << (chan_no * 2)))
+        continue;
+
+      c->prdt = palloc_get_page (0);
+      if (c->prdt != NULL)
+        c->bm_base = (bar & ~3u) + chan_no * 8;
+    }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -191,9 +285,9 @@ reset_channel (struct channel *c)
   /* Issue soft reset sequence, which selects device 0 as a side effect.
      Also enable interrupts. */
   outb (reg_ctl (c), 0);
-  timer_usleep (10);
+  timer_udelay (10);
   outb (reg_ctl (c), CTL_SRST);
-  timer_usleep (10);
+  timer_udelay (10);
   outb (reg_ctl (c), 0);
 
   timer_msleep (150);
@@ -281,6 +375,10 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
+  /* Use DMA if both the channel and the disk support it.  Word
+     49, bit 8 of the identify data is the DMA capability bit. */
+  d->use_dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
@@ -303,6 +401,9 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  if (d->use_dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,25 +438,71 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and BUFFER, reading if WRITE is false and writing otherwise,
+   with one command per IDE_MAX_SECTORS sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              uint8_t *buffer, bool write)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      block_sector_t n = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+      block_sector_t i;
+
+      if (!dma_transfer (d, sec_no, n, buffer, write))
+        {
+          /* PIO: the disk interrupts once per sector, after the
+             sector is ready to be read or has been written. */
+          select_sector (d, sec_no, n);
+          if (!write)
+            {
+              issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+              for (i = 0; i < n; i++)
+                {
+                  sema_down (&c->completion_wait);
+                  if (!wait_while_busy (d))
+                    PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                           d->name, sec_no + i);
+                  input_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+                }
+            }
+          else
+            {
+              issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+              for (i = 0; i < n; i++)
+                {
+                  if (!wait_while_busy (d))
+                    PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                           d->name, sec_no + i);
+                  output_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+                  sema_down (&c->completion_wait);
+                }
+            }
+        }
+
+      sec_no += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_transfer (d_, sec_no, 1, buffer, false);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
@@ -363,37 +510,153 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_transfer (d_, sec_no, 1, (uint8_t *) buffer, true);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                   void *buffer)
+{
+  ide_transfer (d_, sec_no, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                    const void *buffer)
+{
+  ide_transfer (d_, sec_no, cnt, (uint8_t *) buffer, true);
+}
+
+/* Queues REQ, a request for disk D, on D's channel.  The
+   channel's dispatcher thread carries it out in elevator order,
+   possibly merged with other requests. */
+static void
+ide_submit (void *d_, struct block_request *req)
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  req->driver_data = d;
+  block_queue_add (&d->channel->queue, req);
+}
+
+/* Called by a channel's dispatcher thread to transfer the CNT
+   sectors starting at SEC_NO between BUFFER and the disk that REQ
+   is for. */
+static void
+ide_queue_transfer (struct block_request *req, block_sector_t sec_no,
+                    block_sector_t cnt, void *buffer, bool write)
+{
+  ide_transfer (req->driver_data, sec_no, cnt, buffer, write);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_submit
   };
-
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER, splitting the buffer at page boundaries since
+   consecutive virtual pages need not be physically contiguous.
+   (A page never crosses a 64 kB boundary.)  Returns false if
+   BUFFER cannot be reached by DMA. */
+static bool
+setup_prdt (struct channel *c, const void *buffer, size_t size) 
+{
+  const uint8_t *p = buffer;
+  struct prd *prd = c->prdt;
+
+  if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1) != 0)
+    return false;
+
+  while (size > 0) 
+    {
+      size_t chunk = PGSIZE - pg_ofs (p);
+      if (chunk > size)
+        chunk = size;
+      if (prd >= c->prdt + PGSIZE / sizeof *prd)
+        return false;
+
+      prd->addr = vtop (p);
+      prd->size = chunk;
+      prd->flags = 0;
+      prd++;
+
+      p += chunk;
+      size -= chunk;
+    }
+  prd[-1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO of disk D to or
+   from BUFFER by bus master DMA, as a single command, sleeping
+   until the transfer completes.  Must be
+   called with D's channel lock held.  Returns false, without
+   transferring anything, if D does not use DMA or BUFFER cannot
+   be used for DMA; also returns false, and switches D back to
+   PIO for good, if the transfer fails. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              void *buffer, bool write) 
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status, status;
+
+  ASSERT (cnt > 0 && cnt <= IDE_MAX_SECTORS);
+  if (!d->use_dma || !setup_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  /* Point the channel at the PRD table and clear stale status. */
+  outl (reg_bmprdt (c), vtop (c->prdt));
+  outb (reg_bmcmd (c), direction);
+  outb (reg_bmstatus (c), inb (reg_bmstatus (c)) | BM_STA_ERROR | BM_STA_IRQ);
+
+  /* Issue the command, then start the bus master. */
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bmcmd (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  /* Stop the bus master and check the outcome. */
+  bm_status = inb (reg_bmstatus (c));
+  outb (reg_bmcmd (c), direction);
+  outb (reg_bmstatus (c), bm_status | BM_STA_ERROR | BM_STA_IRQ);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BM_STA_ERROR) || (status & STA_ERR)) 
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->use_dma = false;
+      return false;
+    }
+  return true;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between
+   1 and IDE_MAX_SECTORS, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= IDE_MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == IDE_MAX_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -446,7 +709,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -489,7 +752,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
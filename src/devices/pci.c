@@ -0,0 +1,154 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/io.h"
+
+/* The code in this file finds devices on the PCI bus through
+   configuration mechanism #1, which every PC chipset that
+   Pintos runs on (and QEMU and Bochs) supports. */
+
+/* Configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Address of register to access. */
+#define PCI_CONFIG_DATA 0xcfc   /* Data for that register. */
+
+/* Configuration space registers. */
+#define PCI_REG_ID 0x00         /* Vendor ID 0:15, device ID 16:31. */
+#define PCI_REG_COMMAND 0x04    /* Command 0:15, status 16:31. */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 16:23. */
+#define PCI_REG_BAR0 0x10       /* First base address register. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line in bits 0:7. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEM 0x0002      /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Enable bus mastering. */
+
+/* Header type bit set on functions of multifunction devices. */
+#define PCI_HEADER_MULTIFUNC 0x80
+
+/* Devices found by pci_init(). */
+#define PCI_MAX_DEVS 32
+static struct pci_dev devices[PCI_MAX_DEVS];
+static size_t dev_cnt;
+
+/* Reads configuration register REG of BUS:DEV.FUNC. */
+static uint32_t
+read_config (uint8_t bus, uint8_t dev, uint8_t func, uint8_t reg) 
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & 0xfc)));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Records BUS:DEV.FUNC, which must exist, in the device table. */
+static void
+add_device (uint8_t bus, uint8_t dev, uint8_t func) 
+{
+  struct pci_dev *d;
+  uint32_t id, class;
+
+  if (dev_cnt >= PCI_MAX_DEVS)
+    return;
+
+  id = read_config (bus, dev, func, PCI_REG_ID);
+  class = read_config (bus, dev, func, PCI_REG_CLASS);
+
+  d = &devices[dev_cnt++];
+  d->bus = bus;
+  d->dev = dev;
+  d->func = func;
+  d->vendor_id = id;
+  d->device_id = id >> 16;
+  d->class = class >> 24;
+  d->subclass = class >> 16;
+  d->prog_if = class >> 8;
+  d->irq = read_config (bus, dev, func, PCI_REG_IRQ);
+}
+
+/* Scans the PCI bus and records the devices found. */
+void
+pci_init (void) 
+{
+  int bus, dev, func;
+
+  dev_cnt = 0;
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++) 
+      {
+        int func_cnt = 1;
+
+        if ((read_config (bus, dev, 0, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+        if (read_config (bus, dev, 0, PCI_REG_HEADER)
+            & (PCI_HEADER_MULTIFUNC << 16))
+          func_cnt = 8;
+        for (func = 0; func < func_cnt; func++)
+          if ((read_config (bus, dev, func, PCI_REG_ID) & 0xffff) != 0xffff)
+            add_device (bus, dev, func);
+      }
+}
+
+/* Returns the first device after PREV (or the first device at
+   all, if PREV is null) with the given CLASS and SUBCLASS, or a
+   null pointer if there is none. */
+struct pci_dev *
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *prev) 
+{
+  struct pci_dev *d = prev != NULL ? prev + 1 : devices;
+
+  for (; d < devices + dev_cnt; d++)
+    if (d->class == class && d->subclass == subclass)
+      return d;
+  return NULL;
+}
+
+/* Returns the first device after PREV (or the first device at
+   all, if PREV is null) with the given VENDOR_ID and DEVICE_ID,
+   or a null pointer if there is none. */
+struct pci_dev *
+pci_find_device (uint16_t vendor_id, uint16_t device_id,
+                 struct pci_dev *prev) 
+{
+  struct pci_dev *d = prev != NULL ? prev + 1 : devices;
+
+  for (; d < devices + dev_cnt; d++)
+    if (d->vendor_id == vendor_id && d->device_id == device_id)
+      return d;
+  return NULL;
+}
+
+/* Returns configuration register REG of device D. */
+uint32_t
+pci_read_config (const struct pci_dev *d, uint8_t reg) 
+{
+  return read_config (d->bus, d->dev, d->func, reg);
+}
+
+/* Sets configuration register REG of device D to VALUE. */
+void
+pci_write_config (const struct pci_dev *d, uint8_t reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (d->bus << 16) | (d->dev << 11)
+                          | (d->func << 8) | (reg & 0xfc)));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Returns base address register BAR (0 to 5) of device D, raw:
+   bit 0 is set for an I/O port range, clear for memory. */
+uint32_t
+pci_get_bar (const struct pci_dev *d, int bar) 
+{
+  ASSERT (bar >= 0 && bar < 6);
+  return pci_read_config (d, PCI_REG_BAR0 + bar * 4);
+}
+
+/* Allows device D to respond to I/O and memory accesses and to
+   master the bus, e.g. for DMA. */
+void
+pci_enable_bus_master (const struct pci_dev *d) 
+{
+  uint32_t cmd = pci_read_config (d, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (d, PCI_REG_COMMAND,
+                    cmd | PCI_CMD_IO | PCI_CMD_MEM | PCI_CMD_MASTER);
+}
@@ -0,0 +1,37 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A function on the PCI bus. */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t dev;                /* Device number on BUS. */
+    uint8_t func;               /* Function number within DEV. */
+    uint16_t vendor_id;         /* Vendor ID. */
+    uint16_t device_id;         /* Device ID. */
+    uint8_t class;              /* Base class code. */
+    uint8_t subclass;           /* Subclass code. */
+    uint8_t prog_if;            /* Programming interface. */
+    uint8_t irq;                /* Interrupt line, 0xff if none. */
+  };
+
+/* PCI class codes. */
+#define PCI_CLASS_STORAGE 0x01          /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /* IDE controller. */
+
+void pci_init (void);
+
+struct pci_dev *pci_find_class (uint8_t class, uint8_t subclass,
+                                struct pci_dev *prev);
+struct pci_dev *pci_find_device (uint16_t vendor_id, uint16_t device_id,
+                                 struct pci_dev *prev);
+
+uint32_t pci_read_config (const struct pci_dev *, uint8_t reg);
+void pci_write_config (const struct pci_dev *, uint8_t reg, uint32_t);
+uint32_t pci_get_bar (const struct pci_dev *, int bar);
+void pci_enable_bus_master (const struct pci_dev *);
+
+#endif /* devices/pci.h */
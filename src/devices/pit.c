@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,23 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel 0 of the PIT counting down COUNT cycles, at
+   PIT_HZ cycles per second, in mode 0 ("interrupt on terminal
+   count").  The channel's output drops to 0 and then rises to 1
+   once the count runs out, raising interrupt line 0 a single
+   time.  A COUNT of 0 is treated as 65536.
+
+   Reprogramming channel 0 with pit_configure_channel() puts it
+   back into periodic mode. */
+void
+pit_oneshot (uint16_t count) 
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+  intr_set_level (old_level);
+}
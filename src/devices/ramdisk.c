@@ -0,0 +1,155 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk is a block device whose sectors live in kernel
+   pages.  It lets the file system or swap run without the cost
+   of device I/O, which is useful for benchmarking their
+   algorithms and for running I/O-heavy tests quickly.  Its
+   contents start out zeroed and are lost at shutdown, so a RAM
+   disk used as the file system must be formatted with -f. */
+
+/* Sectors per page of RAM disk storage. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    struct lock lock;           /* Makes each transfer atomic. */
+    size_t page_cnt;            /* Number of pages. */
+    uint8_t **pages;            /* Storage, one page at a time. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk named "ram0" of SIZE_KB kB, rounded up to a
+   whole number of pages, and registers it as a raw block device,
+   which can then be given a role with -filesys or -swap.  Does
+   nothing if SIZE_KB is 0.  If there is not enough memory, prints
+   a message and gives up. */
+void
+ramdisk_init (size_t size_kb)
+{
+  struct ramdisk *rd;
+  size_t i;
+
+  if (size_kb == 0)
+    return;
+
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    goto no_memory;
+  lock_init (&rd->lock);
+  rd->page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  rd->pages = malloc (rd->page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    {
+      free (rd);
+      goto no_memory;
+    }
+  for (i = 0; i < rd->page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        {
+          while (i-- > 0)
+            palloc_free_page (rd->pages[i]);
+          free (rd->pages);
+          free (rd);
+          goto no_memory;
+        }
+    }
+
+  block_register ("ram0", BLOCK_RAW, "RAM disk",
+                  rd->page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, rd);
+  return;
+
+ no_memory:
+  printf ("ram0: not enough memory for %zu kB RAM disk\n", size_kb);
+}
+
+/* Copies the CNT sectors starting at SECTOR between RD and
+   BUFFER, writing to RD if WRITE is true and reading from it
+   otherwise.  The block layer has already checked the sector
+   range. */
+static void
+transfer (struct ramdisk *rd, block_sector_t sector, block_sector_t cnt,
+          void *buffer_, bool write)
+{
+  uint8_t *buffer = buffer_;
+
+  lock_acquire (&rd->lock);
+  while (cnt > 0)
+    {
+      size_t page_ofs = sector % SECTORS_PER_PAGE;
+      block_sector_t run = SECTORS_PER_PAGE - page_ofs;
+      uint8_t *data;
+      size_t size;
+
+      if (run > cnt)
+        run = cnt;
+      data = rd->pages[sector / SECTORS_PER_PAGE]
+             + page_ofs * BLOCK_SECTOR_SIZE;
+      size = run * BLOCK_SECTOR_SIZE;
+      if (write)
+        memcpy (data, buffer, size);
+      else
+        memcpy (buffer, data, size);
+
+      sector += run;
+      cnt -= run;
+      buffer += size;
+    }
+  lock_release (&rd->lock);
+}
+
+/* Reads sector SEC_NO from RD_ into BUFFER, which must have room
+   for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  transfer (rd_, sec_no, 1, buffer, false);
+}
+
+/* Writes sector SEC_NO to RD_ from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  transfer (rd_, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from RD_ into
+   BUFFER. */
+static void
+ramdisk_read_multiple (void *rd_, block_sector_t sec_no,
+                       block_sector_t cnt, void *buffer)
+{
+  transfer (rd_, sec_no, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to RD_ from
+   BUFFER. */
+static void
+ramdisk_write_multiple (void *rd_, block_sector_t sec_no,
+                        block_sector_t cnt, const void *buffer)
+{
+  transfer (rd_, sec_no, cnt, (void *) buffer, true);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL
+  };
@@ -1,7 +1,6 @@
 #include "devices/serial.h"
 #include <debug.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -37,6 +36,14 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RECV 0x02     /* Clear receive FIFO. */
+#define FCR_CLEAR_XMIT 0x04     /* Clear transmit FIFO. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled. */
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,11 +58,23 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, in a ring buffer filled by
+   serial_putc() and serial_putbuf() and drained by the interrupt
+   handler.  TX_HEAD and TX_TAIL only increase, so the number of
+   bytes queued is their difference.  Accessed only with
+   interrupts off. */
+#define TXBUF_SIZE 16384        /* Must be a power of 2. */
+static uint8_t txbuf[TXBUF_SIZE];
+static size_t tx_head, tx_tail;
+
+/* Bytes the transmitter can accept at a time once THR is empty:
+   16 if the UART's FIFO works, otherwise 1. */
+static int fifo_size = 1;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void tx_fill (void);
+static void tx_poll (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -71,7 +90,6 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
   mode = POLL;
 } 
 
@@ -87,6 +105,15 @@ serial_init_queue (void)
     init_poll ();
   ASSERT (mode == POLL);
 
+  /* Turn on the FIFOs, so that each transmit interrupt can send
+     a burst of bytes instead of just one.  The original 16550
+     reports FIFOs that do not work, and the 8250 has none. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RECV | FCR_CLEAR_XMIT);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    fifo_size = 16;
+  else
+    outb (FCR_REG, 0);
+
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable ();
@@ -98,31 +125,51 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the SIZE bytes in BUFFER to the serial port.
+
+   Never sleeps, so it may be called with interrupts off or from
+   an interrupt handler.  Normally it just copies BUFFER into the
+   transmit ring and returns.  If the ring fills up, which only
+   happens if output is produced faster than the port can send
+   it, it makes room by transmitting from the ring by polling. */
+void
+serial_putbuf (const void *buffer_, size_t size) 
+{
+  const uint8_t *buffer = buffer_;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (size-- > 0)
+        putc_poll (*buffer++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      while (size > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t room = TXBUF_SIZE - (tx_head - tx_tail);
+          if (room == 0)
+            tx_poll ();
+          else
+            {
+              if (room > size)
+                room = size;
+              size -= room;
+              while (room-- > 0)
+                txbuf[tx_head++ % TXBUF_SIZE] = *buffer++;
+            }
         }
 
-      intq_putc (&txq, byte); 
+      /* Start transmitting if the port is idle, then let the
+         interrupt handler take care of the rest. */
+      tx_fill ();
       write_ier ();
     }
   
@@ -135,8 +182,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (tx_head != tx_tail)
+    tx_poll ();
   intr_set_level (old_level);
 }
 
@@ -182,7 +229,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (tx_head != tx_tail)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -205,6 +252,34 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* If the transmitter is empty, refills it from the transmit
+   ring with as many bytes as it can accept. */
+static void
+tx_fill (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tx_head != tx_tail && (inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < fifo_size && tx_head != tx_tail; i++)
+        outb (THR_REG, txbuf[tx_tail++ % TXBUF_SIZE]);
+    }
+}
+
+/* Polls the serial port until the transmitter is empty, and then
+   refills it from the transmit ring. */
+static void
+tx_poll (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  tx_fill ();
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +293,8 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the transmitter is empty, refill it. */
+  tx_fill ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -23,26 +23,94 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time-stamp counter cycles per timer tick, or 0 until measured
+   by timer_calibrate(). */
+static uint64_t cycles_per_tick;
+/* Time-stamp counter at timer_init(), the zero of timer_ns(). */
+static uint64_t boot_cycles;
+/* Time-stamp counter at the most recent timer tick. */
+static uint64_t tick_cycles;
+
+/* Tickless idle.
+
+   When the CPU has nothing to do, the idle thread calls
+   timer_idle_enter(), which replaces the periodic timer
+   interrupt by a single one at the next tick that has work to
+   do, as far ahead as the PIT can count.  The first interrupt
+   of any kind then calls timer_idle_exit(), which restores the
+   periodic interrupt and catches up on the ticks that passed in
+   the meantime.
+
+   Switching the PIT back to periodic mode can raise a spurious
+   timer interrupt; RESUME_CYCLES is the time-stamp counter when
+   that last happened, so that a timer interrupt that follows too
+   soon can be ignored. */
+#define IDLE_MAX_TICKS (65535 * TIMER_FREQ / PIT_HZ)
+static bool tickless;
+static bool resumed;
+static uint64_t resume_cycles;
+
+/* Pending alarms, in a hierarchical timing wheel.
+
+   Level 0 has a slot for each of the next WHEEL_SIZE ticks.
+   Each slot of level L covers WHEEL_SIZE**L ticks, so the wheel
+   as a whole covers the next WHEEL_SIZE**WHEEL_LEVELS ticks;
+   alarms further out wait in WHEEL_OVERFLOW.  Each tick runs
+   the alarms in one level 0 slot.  Whenever level L wraps
+   around, the next slot of level L + 1 is "cascaded": its alarms
+   are redistributed to lower levels, now that they are closer.
+
+   Setting or cancelling an alarm takes constant time, as does
+   running it, and each alarm is cascaded at most once per
+   level, so the cost of the timer interrupt does not depend on
+   the number of alarms pending.
+
+   WHEEL_NEXT is the next tick whose slot is to be run.
+   Protected by disabling interrupts. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static struct list wheel_overflow;
+static int64_t wheel_next;
+
 static intr_handler_func timer_interrupt;
+static void wheel_insert (struct alarm *);
+static int64_t wheel_next_event (int64_t limit);
+static void run_alarms (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static uint64_t real_time_cycles (int64_t num, int32_t denom);
+static void sleep_until (int64_t tick);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
+  list_init (&wheel_overflow);
+
+  boot_cycles = tick_cycles = timer_cycles ();
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and cycles_per_tick, the rate of the time-stamp counter. */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  uint64_t start_cycles;
+  int64_t start;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
@@ -62,6 +130,17 @@ timer_calibrate (void)
     if (!too_many_loops (high_bit | test_bit))
       loops_per_tick |= test_bit;
 
+  /* Time a few ticks with the time-stamp counter.  Both ends are
+     read by the timer interrupt handler, so they are exact. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start = ticks;
+  start_cycles = tick_cycles;
+  while (ticks < start + 4)
+    barrier ();
+  cycles_per_tick = (tick_cycles - start_cycles) / (ticks - start);
+
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
 }
 
@@ -83,35 +162,76 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
-void
-timer_sleep (int64_t ticks)
+/* Returns the value of the CPU's time-stamp counter, which counts
+   processor clock cycles since reset.  Much finer grained than
+   timer_ticks(), for measuring short intervals, but its rate
+   depends on the CPU. */
+uint64_t
+timer_cycles (void)
 {
-  int64_t start = timer_ticks ();
-
-  struct semaphore sema;
-  sema_init(&sema, 0);
+  uint64_t cycles;
+  asm volatile ("rdtsc" : "=A" (cycles));
+  return cycles;
+}
 
-  struct thread *current_thread = thread_current();
-  current_thread->sleep_time = ticks + start;
-  current_thread->semaphore = &sema;
+/* Returns the rate of the time-stamp counter in cycles per
+   second, or 0 if timer_calibrate() has not measured it yet. */
+uint64_t
+timer_cycle_rate (void)
+{
+  return cycles_per_tick * TIMER_FREQ;
+}
 
-  ASSERT (intr_get_level () == INTR_ON);
-  enum intr_level old_level = intr_disable ();
+/* Returns the number of nanoseconds since the timer was
+   initialized.  Based on the time-stamp counter once
+   timer_calibrate() has measured its rate, so it is much finer
+   grained than timer_ticks(). */
+int64_t
+timer_ns (void) 
+{
+  uint64_t hz = cycles_per_tick * TIMER_FREQ;
+  uint64_t cycles = timer_cycles () - boot_cycles;
 
-  push_to_sleep_thread_list(&(current_thread->sleep_elem));
+  if (hz == 0)
+    return timer_ticks () * (1000 * 1000 * 1000 / TIMER_FREQ);
+  return (cycles / hz * 1000 * 1000 * 1000
+          + cycles % hz * 1000 * 1000 * 1000 / hz);
+}
 
-  intr_set_level (old_level);
-  
-  sema_down(&sema);
+/* Alarm function for sleep_until(), which wakes up the thread
+   waiting on semaphore SEMA. */
+static void
+wake_sleeper (void *sema) 
+{
+  sema_up (sema);
+}
 
+/* Blocks until timer tick TICK.  Interrupts must be turned on. */
+static void
+sleep_until (int64_t tick) 
+{
+  struct semaphore sema;
+  struct alarm alarm;
 
+  ASSERT (intr_get_level () == INTR_ON);
 
+  sema_init (&sema, 0);
+  alarm_init (&alarm, wake_sleeper, &sema);
+  alarm_set (&alarm, tick);
+  sema_down (&sema);
 }
 
+/* Sleeps for approximately TICKS timer ticks.  Interrupts must
+   be turned on. */
+void
+timer_sleep (int64_t ticks) 
+{
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks > 0)
+    sleep_until (timer_ticks () + ticks);
+}
 
-/* Sleeps for approximately MS milliseconds.  Interrupts must be
+/* Sleeps for at least MS milliseconds.  Interrupts must be
    turned on. */
 void
 timer_msleep (int64_t ms) 
@@ -119,16 +239,20 @@ timer_msleep (int64_t ms)
   real_time_sleep (ms, 1000);
 }
 
-/* Sleeps for approximately US microseconds.  Interrupts must be
-   turned on. */
+/* Sleeps for at least US microseconds.  Interrupts must be
+   turned on.  The thread blocks until the first timer tick after
+   the deadline, so short sleeps are rounded up to a tick; use
+   timer_udelay() for brief hardware delays. */
 void
 timer_usleep (int64_t us) 
 {
   real_time_sleep (us, 1000 * 1000);
 }
 
-/* Sleeps for approximately NS nanoseconds.  Interrupts must be
-   turned on. */
+/* Sleeps for at least NS nanoseconds.  Interrupts must be
+   turned on.  The thread blocks until the first timer tick after
+   the deadline, so short sleeps are rounded up to a tick; use
+   timer_ndelay() for brief hardware delays. */
 void
 timer_nsleep (int64_t ns) 
 {
@@ -181,12 +305,240 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If no alarm is due at the next tick, programs
+   the PIT to interrupt just once, when the next alarm is due or
+   as late as it can count, instead of at every tick. */
+void
+timer_idle_enter (void) 
+{
+  int64_t next;
+  uint64_t deadline, now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (cycles_per_tick == 0 || tickless)
+    return;
+
+  next = wheel_next_event (ticks + IDLE_MAX_TICKS);
+  if (next <= ticks + 1)
+    return;
+
+  /* Interrupt when tick NEXT would have come along. */
+  deadline = tick_cycles + (next - ticks) * cycles_per_tick;
+  now = timer_cycles ();
+  if (deadline <= now + cycles_per_tick)
+    return;
+
+  tickless = true;
+  pit_oneshot ((deadline - now) * PIT_HZ / (cycles_per_tick * TIMER_FREQ));
+}
+
+/* Called at the beginning of each external interrupt, with
+   TIMER true for the timer interrupt itself.  Ends a tickless
+   period begun by timer_idle_enter(): restores the periodic
+   timer interrupt, then counts the ticks that passed in the
+   meantime, running their alarms and charging them to the idle
+   thread as if the timer had interrupted at each one.  The timer
+   interrupt counts its own tick. */
+void
+timer_idle_exit (bool timer) 
+{
+  uint64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!tickless)
+    return;
+
+  tickless = false;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  now = timer_cycles ();
+  if (!timer)
+    {
+      resumed = true;
+      resume_cycles = now;
+    }
+
+  /* The one-shot interrupt is timed to come at a tick, so round
+     to the nearest tick rather than down for it. */
+  while (now - tick_cycles >= (timer
+                               ? cycles_per_tick * 3 / 2
+                               : cycles_per_tick))
+    {
+      ticks++;
+      tick_cycles += cycles_per_tick;
+      run_alarms ();
+      thread_tick ();
+    }
+}
+
+/* Initializes ALARM to call FUNC with AUX when it goes off.
+   The alarm is not set. */
+void
+alarm_init (struct alarm *alarm, alarm_func *func, void *aux) 
+{
+  ASSERT (alarm != NULL);
+  ASSERT (func != NULL);
+
+  alarm->func = func;
+  alarm->aux = aux;
+  alarm->pending = false;
+}
+
+/* Sets ALARM to go off at timer tick EXPIRES, or at the next tick
+   if EXPIRES has already passed.  If ALARM was already set, its
+   old setting is cancelled.  May be called from an interrupt
+   handler, including an alarm function. */
+void
+alarm_set (struct alarm *alarm, int64_t expires) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (alarm->pending)
+    list_remove (&alarm->elem);
+  alarm->expires = expires;
+  alarm->pending = true;
+  wheel_insert (alarm);
+
+  intr_set_level (old_level);
+}
+
+/* Cancels ALARM.  Returns true if it was pending, false if it had
+   already gone off or was never set. */
+bool
+alarm_cancel (struct alarm *alarm) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool was_pending = alarm->pending;
+
+  if (was_pending)
+    {
+      list_remove (&alarm->elem);
+      alarm->pending = false;
+    }
+
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Returns true if ALARM is set and has not yet gone off. */
+bool
+alarm_pending (const struct alarm *alarm) 
+{
+  return alarm->pending;
+}
+
+/* Puts ALARM in the timing wheel slot that covers its expiration
+   time.  Interrupts must be off. */
+static void
+wheel_insert (struct alarm *alarm) 
+{
+  int64_t expires = alarm->expires > wheel_next ? alarm->expires : wheel_next;
+  int64_t delta = expires - wheel_next;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      {
+        int slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        list_push_back (&wheel[level][slot], &alarm->elem);
+        return;
+      }
+  list_push_back (&wheel_overflow, &alarm->elem);
+}
+
+/* Returns the first tick before LIMIT at which the wheel has
+   alarms to run or a level to cascade, or LIMIT if there is
+   none.  Interrupts must be off. */
+static int64_t
+wheel_next_event (int64_t limit) 
+{
+  int64_t tick;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (tick = wheel_next; tick < limit; tick++)
+    if ((tick & WHEEL_MASK) == 0
+        || !list_empty (&wheel[0][tick & WHEEL_MASK]))
+      return tick;
+  return limit;
+}
+
+/* Moves all the alarms in LIST back into the wheel, each in the
+   slot now appropriate for it. */
+static void
+cascade (struct list *list) 
+{
+  while (!list_empty (list))
+    wheel_insert (list_entry (list_pop_front (list), struct alarm, elem));
+}
+
+/* Runs the alarms due at each tick up to the current one.
+   Interrupts must be off. */
+static void
+run_alarms (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_next <= ticks)
+    {
+      int slot = wheel_next & WHEEL_MASK;
+      struct list *due = &wheel[0][slot];
+      struct list expired;
+
+      /* At a level 0 wraparound, cascade the next slot of level
+         1, and so on up as further levels wrap around. */
+      if (slot == 0)
+        {
+          int level;
+
+          for (level = 1; level < WHEEL_LEVELS; level++)
+            {
+              int idx = (wheel_next >> (WHEEL_BITS * level)) & WHEEL_MASK;
+              cascade (&wheel[level][idx]);
+              if (idx != 0)
+                break;
+            }
+          if (level == WHEEL_LEVELS)
+            cascade (&wheel_overflow);
+        }
+
+      /* Take the due alarms off the wheel before running any of
+         them, because an alarm function may set an alarm again. */
+      list_init (&expired);
+      while (!list_empty (due))
+        list_push_back (&expired, list_pop_front (due));
+      wheel_next++;
+
+      while (!list_empty (&expired))
+        {
+          struct alarm *alarm = list_entry (list_pop_front (&expired),
+                                            struct alarm, elem);
+          alarm->pending = false;
+          alarm->func (alarm->aux);
+        }
+    }
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  uint64_t now = timer_cycles ();
+
+  /* Ignore a spurious interrupt from timer_idle_exit()
+     reprogramming the PIT; the first real one is a tick later. */
+  if (resumed)
+    {
+      resumed = false;
+      if (now - resume_cycles < cycles_per_tick / 2)
+        return;
+    }
+
   ticks++;
-  wake_threads();
+  tick_cycles = now;
+  run_alarms ();
   thread_tick ();
 }
 
@@ -223,40 +575,69 @@ busy_wait (int64_t loops)
     barrier ();
 }
 
-/* Sleep for approximately NUM/DENOM seconds. */
+/* Sleeps for at least NUM/DENOM seconds, by blocking until the
+   first timer tick after the deadline. */
 static void
 real_time_sleep (int64_t num, int32_t denom) 
 {
-  /* Convert NUM/DENOM seconds into timer ticks, rounding down.
-          
-        (NUM / DENOM) s          
-     ---------------------- = NUM * TIMER_FREQ / DENOM ticks. 
-     1 s / TIMER_FREQ ticks
-  */
-  int64_t ticks = num * TIMER_FREQ / denom;
+  enum intr_level old_level;
+  int64_t tick;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
-    {
-      /* We're waiting for at least one full timer tick.  Use
-         timer_sleep() because it will yield the CPU to other
-         processes. */                
-      timer_sleep (ticks); 
-    }
-  else 
+  if (num <= 0)
+    return;
+
+  if (cycles_per_tick == 0)
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
-      real_time_delay (num, denom); 
+      /* Not calibrated yet.  Convert NUM/DENOM seconds into timer
+         ticks, rounding up, plus one because the current tick is
+         already partly over.
+          
+            (NUM / DENOM) s          
+         ---------------------- = NUM * TIMER_FREQ / DENOM ticks. 
+         1 s / TIMER_FREQ ticks
+      */
+      timer_sleep (DIV_ROUND_UP (num * TIMER_FREQ, denom) + 1);
+      return;
     }
+
+  /* Count whole ticks from the last one to the deadline. */
+  old_level = intr_disable ();
+  tick = ticks + DIV_ROUND_UP (timer_cycles () - tick_cycles
+                               + real_time_cycles (num, denom),
+                               cycles_per_tick);
+  intr_set_level (old_level);
+  sleep_until (tick);
 }
 
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
+  if (cycles_per_tick != 0)
+    {
+      uint64_t start = timer_cycles ();
+      uint64_t cycles = real_time_cycles (num, denom);
+
+      while (timer_cycles () - start < cycles)
+        barrier ();
+      return;
+    }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
   busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
+
+/* Converts NUM/DENOM seconds into time-stamp counter cycles.
+   Divides first to avoid the possibility of overflow. */
+static uint64_t
+real_time_cycles (int64_t num, int32_t denom) 
+{
+  uint64_t hz = cycles_per_tick * TIMER_FREQ;
+
+  if (num <= 0)
+    return 0;
+  return num / denom * hz + num % denom * hz / denom;
+}
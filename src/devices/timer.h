@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -12,6 +14,9 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+uint64_t timer_cycles (void);
+uint64_t timer_cycle_rate (void);
+int64_t timer_ns (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -26,4 +31,31 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (bool timer);
+
+/* Kernel timers. */
+
+/* Function called when an alarm goes off.  It runs in the timer
+   interrupt handler, with interrupts off, so it must not sleep. */
+typedef void alarm_func (void *aux);
+
+/* A one-shot kernel timer that calls FUNC with AUX once a given
+   timer tick arrives.  Initialize with alarm_init(); the alarm
+   must stay alive while it is pending. */
+struct alarm
+  {
+    struct list_elem elem;      /* Element in a timing wheel slot. */
+    int64_t expires;            /* Timer tick to go off at. */
+    alarm_func *func;           /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+    bool pending;               /* Set and not yet gone off? */
+  };
+
+void alarm_init (struct alarm *, alarm_func *, void *aux);
+void alarm_set (struct alarm *, int64_t expires);
+bool alarm_cancel (struct alarm *);
+bool alarm_pending (const struct alarm *);
+
 #endif /* devices/timer.h */
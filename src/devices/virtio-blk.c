@@ -0,0 +1,461 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is an interface to virtio block devices,
+   such as those QEMU provides with "-drive if=virtio".  It uses
+   the legacy virtio PCI interface, which QEMU's transitional
+   devices support.  See [virtio] for details.
+
+   Unlike an IDE channel, which carries out one command at a
+   time, a virtio device takes requests through a ring of
+   descriptors shared with it in memory (a "virtqueue") and can
+   work on many of them at once, in any order.  Requests go
+   straight from block_submit() into the virtqueue, and the
+   device reports completion with an interrupt, so this driver
+   has no request queue of its own. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio PCI registers, as offsets from the I/O base in
+   BAR 0. */
+#define VIRTIO_REG_DEVICE_FEATURES 0x00 /* Features offered, 32 bits. */
+#define VIRTIO_REG_GUEST_FEATURES 0x04  /* Features accepted, 32 bits. */
+#define VIRTIO_REG_QUEUE_PFN 0x08       /* Queue page number, 32 bits. */
+#define VIRTIO_REG_QUEUE_SIZE 0x0c      /* Queue size, 16 bits. */
+#define VIRTIO_REG_QUEUE_SELECT 0x0e    /* Queue to configure, 16 bits. */
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10    /* Queue with new requests. */
+#define VIRTIO_REG_STATUS 0x12          /* Device status, 8 bits. */
+#define VIRTIO_REG_ISR 0x13             /* Interrupt status, 8 bits. */
+#define VIRTIO_REG_CONFIG 0x14          /* Device configuration. */
+
+/* Device status bits. */
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01  /* Guest noticed the device. */
+#define VIRTIO_STATUS_DRIVER 0x02       /* Guest has a driver for it. */
+#define VIRTIO_STATUS_DRIVER_OK 0x04    /* Driver is ready. */
+#define VIRTIO_STATUS_FAILED 0x80       /* Driver gave up. */
+
+/* Interrupt status bit for a used ring update. */
+#define VIRTIO_ISR_QUEUE 0x01
+
+/* Block device feature bit for a read-only device. */
+#define VIRTIO_BLK_F_RO (1u << 5)
+
+/* Block request types and status. */
+#define VIRTIO_BLK_T_IN 0               /* Read. */
+#define VIRTIO_BLK_T_OUT 1              /* Write. */
+#define VIRTIO_BLK_S_OK 0               /* Success. */
+
+/* Descriptor flags. */
+#define VRING_DESC_F_NEXT 1             /* NEXT is valid. */
+#define VRING_DESC_F_WRITE 2            /* Device writes the buffer. */
+
+/* Alignment of the used ring in legacy virtqueues. */
+#define VRING_ALIGN PGSIZE
+
+/* A buffer descriptor in a virtqueue. */
+struct vring_desc
+  {
+    uint64_t addr;                      /* Physical address. */
+    uint32_t len;                       /* Length in bytes. */
+    uint16_t flags;                     /* VRING_DESC_F_*. */
+    uint16_t next;                      /* Next descriptor in chain. */
+  };
+
+/* Ring of descriptor chains made available to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    uint16_t ring[];                    /* Heads of descriptor chains. */
+  };
+
+/* An entry in the used ring. */
+struct vring_used_elem
+  {
+    uint32_t id;                        /* Head of descriptor chain. */
+    uint32_t len;                       /* Bytes written by device. */
+  };
+
+/* Ring of descriptor chains the device has finished with. */
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header of a block request, followed in its descriptor chain by
+   the data and then by STATUS, which the device fills in. */
+struct virtio_blk_hdr
+  {
+    uint32_t type;                      /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;                    /* First sector. */
+    uint8_t status;                     /* VIRTIO_BLK_S_*. */
+  };
+
+/* Descriptors used by each request: header, data, status. */
+#define DESCS_PER_REQUEST 3
+
+/* A virtio block device. */
+struct vblk
+  {
+    char name[8];                       /* Name, e.g. "vda". */
+    uint16_t io_base;                   /* Base I/O port. */
+    uint8_t irq;                        /* Interrupt vector. */
+
+    /* Virtqueue, in physically contiguous pages. */
+    uint16_t qsize;                     /* Number of descriptors. */
+    struct vring_desc *desc;            /* Descriptor table. */
+    struct vring_avail *avail;          /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t last_used;                 /* Next used entry to process. */
+
+    /* Per-request data, indexed by descriptor chain head. */
+    struct virtio_blk_hdr *hdrs;        /* Request headers. */
+    struct block_request **reqs;        /* Requests in flight. */
+
+    struct lock lock;                   /* Protects all of the above. */
+    struct condition desc_free;         /* Signaled when descs freed. */
+    uint16_t free_head;                 /* First free descriptor. */
+    uint16_t free_cnt;                  /* Number of free descriptors. */
+
+    struct semaphore used_wait;         /* Upped by interrupt handler. */
+  };
+
+/* We support up to this many virtio block devices. */
+#define VBLK_MAX 4
+static struct vblk vblks[VBLK_MAX];
+static size_t vblk_cnt;
+
+static struct block_operations vblk_operations;
+
+static bool init_device (struct vblk *, struct pci_dev *);
+static bool init_queue (struct vblk *);
+static thread_func completion_thread NO_RETURN;
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds virtio block devices on the PCI bus and registers them
+   as "vda", "vdb", and so on. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev *pd = NULL;
+
+  while ((pd = pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, pd))
+         != NULL
+         && vblk_cnt < VBLK_MAX)
+    {
+      /* Count D before initializing it, so that the interrupt
+         handler sees it while partition_scan() reads from it. */
+      struct vblk *d = &vblks[vblk_cnt++];
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) (d - vblks));
+      if (!init_device (d, pd))
+        vblk_cnt--;
+    }
+}
+
+/* Initializes D for PCI device PD and registers it.  Returns
+   true if successful, false on failure. */
+static bool
+init_device (struct vblk *d, struct pci_dev *pd)
+{
+  uint32_t bar = pci_get_bar (pd, 0);
+  uint32_t features;
+  block_sector_t capacity;
+  enum block_type type;
+  struct block *block;
+  size_t i;
+
+  if (!(bar & 1) || pd->irq >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt, ignoring\n", d->name);
+      return false;
+    }
+  d->io_base = bar & ~3u;
+  d->irq = pd->irq + 0x20;
+  pci_enable_bus_master (pd);
+
+  /* Reset the device, then tell it we know how to drive it.  We
+     accept none of its optional features. */
+  outb (d->io_base + VIRTIO_REG_STATUS, 0);
+  outb (d->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+  outb (d->io_base + VIRTIO_REG_STATUS,
+        VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+  features = inl (d->io_base + VIRTIO_REG_DEVICE_FEATURES);
+  outl (d->io_base + VIRTIO_REG_GUEST_FEATURES, 0);
+
+  lock_init (&d->lock);
+  cond_init (&d->desc_free);
+  sema_init (&d->used_wait, 0);
+  if (!init_queue (d))
+    {
+      outb (d->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+      return false;
+    }
+
+  /* Capacity is a 64-bit count of sectors.  Devices too big for
+     block_sector_t are truncated. */
+  capacity = inl (d->io_base + VIRTIO_REG_CONFIG);
+  if (inl (d->io_base + VIRTIO_REG_CONFIG + 4) != 0)
+    capacity = UINT32_MAX;
+
+  /* Register the interrupt handler, unless a device found earlier
+     shares our interrupt line. */
+  for (i = 0; vblks + i < d; i++)
+    if (vblks[i].irq == d->irq)
+      break;
+  if (vblks + i == d)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+  thread_create (d->name, PRI_MAX, completion_thread, d);
+
+  outb (d->io_base + VIRTIO_REG_STATUS,
+        (VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER
+         | VIRTIO_STATUS_DRIVER_OK));
+
+  /* Treat read-only devices as foreign, so we never write them. */
+  type = features & VIRTIO_BLK_F_RO ? BLOCK_FOREIGN : BLOCK_RAW;
+  block = block_register (d->name, type, "virtio", capacity,
+                          &vblk_operations, d);
+  partition_scan (block);
+  return true;
+}
+
+/* Sets up D's virtqueue.  Returns true if successful, false on
+   failure. */
+static bool
+init_queue (struct vblk *d)
+{
+  size_t avail_ofs, used_ofs, ring_size, hdr_pages;
+  uint8_t *ring;
+  uint16_t i;
+
+  outw (d->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+  d->qsize = inw (d->io_base + VIRTIO_REG_QUEUE_SIZE);
+  if (d->qsize < DESCS_PER_REQUEST)
+    {
+      printf ("%s: no usable virtqueue\n", d->name);
+      return false;
+    }
+
+  /* Legacy layout: descriptor table, then available ring, then
+     used ring on the next VRING_ALIGN boundary.  The device
+     chooses the queue size, so we cannot shrink it. */
+  avail_ofs = d->qsize * sizeof *d->desc;
+  used_ofs = ROUND_UP (avail_ofs + sizeof *d->avail
+                       + (d->qsize + 1) * sizeof (uint16_t), VRING_ALIGN);
+  ring_size = used_ofs + sizeof *d->used
+              + d->qsize * sizeof (struct vring_used_elem) + sizeof (uint16_t);
+  ring = palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (ring_size, PGSIZE));
+  hdr_pages = DIV_ROUND_UP (d->qsize * sizeof *d->hdrs
+                            + d->qsize * sizeof *d->reqs, PGSIZE);
+  d->hdrs = palloc_get_multiple (PAL_ZERO, hdr_pages);
+  if (ring == NULL || d->hdrs == NULL)
+    {
+      printf ("%s: not enough memory for virtqueue\n", d->name);
+      if (ring != NULL)
+        palloc_free_multiple (ring, DIV_ROUND_UP (ring_size, PGSIZE));
+      if (d->hdrs != NULL)
+        palloc_free_multiple (d->hdrs, hdr_pages);
+      return false;
+    }
+  d->reqs = (struct block_request **) (d->hdrs + d->qsize);
+
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + avail_ofs);
+  d->used = (struct vring_used *) (ring + used_ofs);
+  d->last_used = 0;
+
+  /* Chain all the descriptors into the free list. */
+  for (i = 0; i < d->qsize; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = d->qsize;
+
+  outl (d->io_base + VIRTIO_REG_QUEUE_PFN, vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Takes a descriptor off D's free list and returns its index. */
+static uint16_t
+alloc_desc (struct vblk *d)
+{
+  uint16_t i = d->free_head;
+
+  ASSERT (d->free_cnt > 0);
+  d->free_head = d->desc[i].next;
+  d->free_cnt--;
+  return i;
+}
+
+/* Returns the chain of descriptors starting at HEAD to D's free
+   list. */
+static void
+free_chain (struct vblk *d, uint16_t head)
+{
+  for (;;)
+    {
+      struct vring_desc *desc = &d->desc[head];
+      uint16_t next = desc->next;
+      bool more = (desc->flags & VRING_DESC_F_NEXT) != 0;
+
+      desc->flags = 0;
+      desc->next = d->free_head;
+      d->free_head = head;
+      d->free_cnt++;
+      if (!more)
+        break;
+      head = next;
+    }
+}
+
+/* Sets descriptor I in D to the SIZE bytes at kernel virtual
+   address BUFFER, with the given FLAGS and NEXT. */
+static void
+set_desc (struct vblk *d, uint16_t i, void *buffer, uint32_t size,
+          uint16_t flags, uint16_t next)
+{
+  d->desc[i].addr = vtop (buffer);
+  d->desc[i].len = size;
+  d->desc[i].flags = flags;
+  d->desc[i].next = next;
+}
+
+/* Adds REQ to D_'s virtqueue and notifies the device.  Waits for
+   free descriptors if the virtqueue is full. */
+static void
+vblk_submit (void *d_, struct block_request *req)
+{
+  struct vblk *d = d_;
+  struct virtio_blk_hdr *hdr;
+  uint16_t head, data, status;
+
+  /* Kernel virtual memory maps physical memory contiguously, so
+     any kernel buffer is one physical extent. */
+  ASSERT (is_kernel_vaddr (req->buffer));
+
+  lock_acquire (&d->lock);
+  while (d->free_cnt < DESCS_PER_REQUEST)
+    cond_wait (&d->desc_free, &d->lock);
+
+  head = alloc_desc (d);
+  data = alloc_desc (d);
+  status = alloc_desc (d);
+
+  hdr = &d->hdrs[head];
+  hdr->type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  hdr->reserved = 0;
+  hdr->sector = req->sector;
+  hdr->status = 0xff;
+  d->reqs[head] = req;
+
+  set_desc (d, head, hdr, offsetof (struct virtio_blk_hdr, status),
+            VRING_DESC_F_NEXT, data);
+  set_desc (d, data, req->buffer, req->cnt * BLOCK_SECTOR_SIZE,
+            VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE),
+            status);
+  set_desc (d, status, &hdr->status, 1, VRING_DESC_F_WRITE, 0);
+
+  /* Publish the chain, then its index, then tell the device. */
+  d->avail->ring[d->avail->idx % d->qsize] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  req->dispatch_time = timer_cycles ();
+  outw (d->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+
+  lock_release (&d->lock);
+}
+
+/* Completion thread for virtio block device D_.  Block
+   completion callbacks may not run in an interrupt handler, so
+   the handler wakes up this thread to retire finished
+   requests. */
+static void
+completion_thread (void *d_)
+{
+  struct vblk *d = d_;
+
+  for (;;)
+    {
+      struct list done;
+
+      list_init (&done);
+      sema_down (&d->used_wait);
+
+      lock_acquire (&d->lock);
+      while (d->last_used != d->used->idx)
+        {
+          uint16_t head = d->used->ring[d->last_used % d->qsize].id;
+          struct block_request *req = d->reqs[head];
+
+          if (d->hdrs[head].status != VIRTIO_BLK_S_OK)
+            PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+                   d->name, req->write ? "write" : "read", req->sector);
+          d->reqs[head] = NULL;
+          free_chain (d, head);
+          list_push_back (&done, &req->elem);
+          d->last_used++;
+        }
+      cond_broadcast (&d->desc_free, &d->lock);
+      lock_release (&d->lock);
+
+      while (!list_empty (&done))
+        block_complete (list_entry (list_pop_front (&done),
+                                    struct block_request, elem));
+    }
+}
+
+/* Virtio block interrupt handler. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct vblk *d;
+
+  /* Reading the interrupt status acknowledges the interrupt. */
+  for (d = vblks; d < vblks + vblk_cnt; d++)
+    if (f->vec_no == d->irq
+        && (inb (d->io_base + VIRTIO_REG_ISR) & VIRTIO_ISR_QUEUE))
+      sema_up (&d->used_wait);
+}
+
+/* Synchronous operations are never called, because the block
+   layer sends every transfer through vblk_submit(). */
+static void
+vblk_read (void *d UNUSED, block_sector_t sec_no UNUSED,
+           void *buffer UNUSED)
+{
+  NOT_REACHED ();
+}
+
+static void
+vblk_write (void *d UNUSED, block_sector_t sec_no UNUSED,
+            const void *buffer UNUSED)
+{
+  NOT_REACHED ();
+}
+
+static struct block_operations vblk_operations =
+  {
+    vblk_read,
+    vblk_write,
+    NULL,
+    NULL,
+    vblk_submit
+  };
@@ -0,0 +1,325 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <round.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors held by the cache. */
+#define CACHE_SIZE 64
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector held, if valid. */
+    block_sector_t owner;               /* Inode sector owning SECTOR. */
+    bool valid;                         /* Holds a sector? */
+    bool dirty;                         /* Modified since last write? */
+    bool accessed;                      /* Used since last clock sweep? */
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static size_t clock_hand;               /* Next eviction candidate. */
+
+/* Protects all of the above.  Held across device I/O, so that
+   two threads never load the same sector into two entries. */
+static struct lock cache_lock;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void) 
+{
+  size_t page_cnt = DIV_ROUND_UP (CACHE_SIZE * BLOCK_SECTOR_SIZE, PGSIZE);
+  uint8_t *base = palloc_get_multiple (PAL_ASSERT, page_cnt);
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++) 
+    {
+      cache[i].valid = false;
+      cache[i].data = base + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+  lock_init (&cache_lock);
+}
+
+/* Writes E back to the file system device if it is dirty. */
+static void
+write_back (struct cache_entry *e) 
+{
+  if (e->valid && e->dirty) 
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+    }
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer. */
+static struct cache_entry *
+lookup (block_sector_t sector) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Picks an entry with the clock algorithm, writes it back if
+   needed, and returns it, now invalid. */
+static struct cache_entry *
+evict (void) 
+{
+  struct cache_entry *e;
+
+  for (;;) 
+    {
+      e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (!e->valid)
+        break;
+      if (!e->accessed)
+        {
+          write_back (e);
+          break;
+        }
+      e->accessed = false;
+    }
+  e->valid = false;
+  return e;
+}
+
+/* Returns the entry for SECTOR, owned by OWNER, loading it from
+   the device first if LOAD is true.  Must be called with
+   cache_lock held. */
+static struct cache_entry *
+get_entry (block_sector_t owner, block_sector_t sector, bool load) 
+{
+  struct cache_entry *e = lookup (sector);
+
+  if (e == NULL) 
+    {
+      e = evict ();
+      if (load)
+        block_read (fs_device, sector, e->data);
+      e->sector = sector;
+      e->dirty = false;
+      e->valid = true;
+    }
+  e->owner = owner;
+  e->accessed = true;
+  return e;
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes, through the cache. */
+void
+cache_read (block_sector_t sector, void *buffer) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      /* Sectors never read before are tagged with themselves as
+         owner until they are written. */
+      e = get_entry (sector, sector, true);
+    }
+  e->accessed = true;
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  lock_release (&cache_lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR, which
+   belongs to the inode at OWNER.  The data only reaches the
+   device when the sector is evicted or flushed. */
+void
+cache_write (block_sector_t owner, block_sector_t sector,
+             const void *buffer) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = get_entry (owner, sector, false);
+  memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Copies sector SRC to sector DST, which belongs to the inode at
+   OWNER, from one cache entry straight into the other.  Like
+   cache_write(), the copy only reaches the device when DST is
+   evicted or flushed. */
+void
+cache_copy (block_sector_t owner, block_sector_t dst, block_sector_t src) 
+{
+  struct cache_entry *d, *s;
+
+  lock_acquire (&cache_lock);
+  do
+    {
+      /* Loading SRC may evict the entry just picked for DST, which
+         is clean until the copy, so try again until both are in
+         the cache at once. */
+      d = get_entry (owner, dst, false);
+      s = lookup (src);
+      if (s == NULL)
+        s = get_entry (src, src, true);
+      s->accessed = true;
+    }
+  while (!d->valid || d->sector != dst);
+  memcpy (d->data, s->data, BLOCK_SECTOR_SIZE);
+  d->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER, which
+   must have room for CNT * BLOCK_SECTOR_SIZE bytes, with a single
+   device request.  The run bypasses the cache, except that
+   sectors already cached, which may be newer than the disk, are
+   copied from the cache over what the device returned. */
+void
+cache_read_multiple (block_sector_t sector, block_sector_t cnt,
+                     void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  block_read_multiple (fs_device, sector, cnt, buffer);
+  for (i = 0; i < CACHE_SIZE; i++) 
+    {
+      struct cache_entry *e = &cache[i];
+      if (e->valid && e->sector >= sector && e->sector - sector < cnt)
+        memcpy (buffer + (e->sector - sector) * BLOCK_SECTOR_SIZE, e->data,
+                BLOCK_SECTOR_SIZE);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes the CNT sectors starting at SECTOR, which belong to the
+   inode at OWNER, from BUFFER straight to the device with a
+   single request.  Cached copies of those sectors are updated
+   and, now matching the disk, marked clean. */
+void
+cache_write_multiple (block_sector_t owner, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer_) 
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++) 
+    {
+      struct cache_entry *e = &cache[i];
+      if (e->valid && e->sector >= sector && e->sector - sector < cnt)
+        {
+          memcpy (e->data, buffer + (e->sector - sector) * BLOCK_SECTOR_SIZE,
+                  BLOCK_SECTOR_SIZE);
+          e->owner = owner;
+          e->dirty = false;
+        }
+    }
+  block_write_multiple (fs_device, sector, cnt, buffer);
+  lock_release (&cache_lock);
+}
+
+/* Orders cache entries by sector number. */
+static int
+compare_sectors (const void *a_, const void *b_) 
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Completion callback for flush(): ups semaphore SEMA. */
+static void
+flush_done (struct block_request *req UNUSED, void *sema) 
+{
+  sema_up (sema);
+}
+
+/* Writes back the dirty entries owned by OWNER, or every dirty
+   entry if ALL is true, in ascending sector order.  Data
+   sectors are written before inode sectors, so that an inode
+   never reaches the disk ahead of the data it describes.
+
+   The writes of each pass are all submitted before any is
+   waited for, so that the device's request queue can merge
+   adjacent sectors into larger transfers. */
+static void
+flush (block_sector_t owner, bool all) 
+{
+  static struct block_request requests[CACHE_SIZE];
+  struct cache_entry *dirty[CACHE_SIZE];
+  struct semaphore done;
+  size_t dirty_cnt;
+  size_t i;
+  int pass;
+
+  sema_init (&done, 0);
+
+  lock_acquire (&cache_lock);
+  for (pass = 0; pass < 2; pass++) 
+    {
+      bool inodes = pass == 1;
+
+      dirty_cnt = 0;
+      for (i = 0; i < CACHE_SIZE; i++) 
+        {
+          struct cache_entry *e = &cache[i];
+          if (e->valid && e->dirty && (all || e->owner == owner)
+              && (e->sector == e->owner) == inodes)
+            dirty[dirty_cnt++] = e;
+        }
+      qsort (dirty, dirty_cnt, sizeof *dirty, compare_sectors);
+      for (i = 0; i < dirty_cnt; i++) 
+        {
+          block_request_init (&requests[i], fs_device, dirty[i]->sector, 1,
+                              dirty[i]->data, true, flush_done, &done);
+          block_submit (&requests[i]);
+        }
+      for (i = 0; i < dirty_cnt; i++) 
+        {
+          sema_down (&done);
+          dirty[i]->dirty = false;
+        }
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes back every dirty sector owned by the inode at OWNER,
+   including the inode itself. */
+void
+cache_flush (block_sector_t owner) 
+{
+  flush (owner, false);
+}
+
+/* Writes back every dirty sector in the cache. */
+void
+cache_flush_all (void) 
+{
+  flush (0, true);
+}
+
+/* Drops every sector owned by the inode at OWNER without writing
+   it back.  Used when a removed inode releases its sectors. */
+void
+cache_discard (block_sector_t owner) 
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].owner == owner)
+      cache[i].valid = false;
+  lock_release (&cache_lock);
+}
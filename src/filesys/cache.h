@@ -0,0 +1,27 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+/* Write-back cache of file system sectors.
+
+   Every sector in the cache is tagged with an owner, the sector
+   of the inode whose data it holds (an inode sector owns
+   itself), so that the dirty sectors of a single file can be
+   written back on demand. */
+
+void cache_init (void);
+void cache_read (block_sector_t sector, void *buffer);
+void cache_write (block_sector_t owner, block_sector_t sector,
+                  const void *buffer);
+void cache_read_multiple (block_sector_t sector, block_sector_t cnt,
+                          void *buffer);
+void cache_write_multiple (block_sector_t owner, block_sector_t sector,
+                           block_sector_t cnt, const void *buffer);
+void cache_copy (block_sector_t owner, block_sector_t dst,
+                 block_sector_t src);
+void cache_flush (block_sector_t owner);
+void cache_flush_all (void);
+void cache_discard (block_sector_t owner);
+
+#endif /* filesys/cache.h */
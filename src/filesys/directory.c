@@ -19,14 +19,18 @@ struct dir_entry
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool is_dir;                        /* Names a directory? */
   };
 
+/* Number of entries read at a time by dir_getdents(). */
+#define GETDENTS_BATCH 16
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -76,6 +80,22 @@ dir_close (struct dir *dir)
     }
 }
 
+/* Sets the current position in DIR to POS bytes from the start. */
+void
+dir_seek (struct dir *dir, off_t pos) 
+{
+  ASSERT (dir != NULL);
+  dir->pos = pos;
+}
+
+/* Returns the current position in DIR, in bytes from the start. */
+off_t
+dir_tell (struct dir *dir) 
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
+}
+
 /* Returns the inode encapsulated by DIR. */
 struct inode *
 dir_get_inode (struct dir *dir) 
@@ -134,12 +154,13 @@ dir_lookup (const struct dir *dir, const char *name,
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR and is a directory if IS_DIR is true.
    Returns true if successful, false on failure.
    Fails if NAME is invalid (i.e. too long) or a disk or memory
    error occurs. */
 bool
-dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
+         bool is_dir)
 {
   struct dir_entry e;
   off_t ofs;
@@ -172,6 +193,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+  e.is_dir = is_dir;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
@@ -234,3 +256,60 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Fills BUFFER, which is SIZE bytes long, with as many packed
+   `struct dirent' records for the in-use entries of DIR as fit,
+   starting from DIR's current position, and advances DIR past
+   them.  The directory is read several entries at a time.
+   Returns the number of bytes filled in, 0 at the end of the
+   directory, or -1 if the next entry does not fit in BUFFER at
+   all. */
+int
+dir_getdents (struct dir *dir, void *buffer, size_t size)
+{
+  struct dir_entry *entries;
+  uint8_t *out = buffer;
+  size_t filled = 0;
+  bool full = false;
+
+  entries = malloc (GETDENTS_BATCH * sizeof *entries);
+  if (entries == NULL)
+    return -1;
+
+  while (!full) 
+    {
+      off_t bytes = inode_read_at (dir->inode, entries,
+                                   GETDENTS_BATCH * sizeof *entries,
+                                   dir->pos);
+      size_t cnt = bytes / sizeof *entries;
+      size_t i;
+
+      if (cnt == 0)
+        break;
+      for (i = 0; i < cnt; i++) 
+        {
+          struct dir_entry *e = &entries[i];
+          if (e->in_use)
+            {
+              size_t name_len = strlen (e->name);
+              size_t reclen = DIRENT_RECLEN (name_len);
+              struct dirent *d = (struct dirent *) (out + filled);
+
+              if (filled + reclen > size)
+                {
+                  full = true;
+                  break;
+                }
+              d->d_ino = e->inode_sector;
+              d->d_reclen = reclen;
+              d->d_is_dir = e->is_dir;
+              memcpy (d->d_name, e->name, name_len + 1);
+              filled += reclen;
+            }
+          dir->pos += sizeof *e;
+        }
+    }
+  free (entries);
+
+  return filled == 0 && full ? -1 : (int) filled;
+}
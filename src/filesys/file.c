@@ -106,6 +106,88 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads from FILE into the IOVCNT buffers described by IOV,
+   starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_read = inode_readv_at (file->inode, iov, iovcnt, file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the IOVCNT buffers described by IOV into FILE,
+   starting at the file's current position.
+   Returns the number of bytes actually written,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_written = inode_writev_at (file->inode, iov, iovcnt,
+                                         file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Reads from FILE into the IOVCNT buffers described by IOV,
+   starting at offset FILE_OFS in the file.
+   Returns the number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_readv_at (struct file *file, const struct iovec *iov, int iovcnt,
+               off_t file_ofs) 
+{
+  return inode_readv_at (file->inode, iov, iovcnt, file_ofs);
+}
+
+/* Writes the IOVCNT buffers described by IOV into FILE,
+   starting at offset FILE_OFS in the file.
+   Returns the number of bytes actually written,
+   which may be less than requested if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_writev_at (struct file *file, const struct iovec *iov, int iovcnt,
+                off_t file_ofs) 
+{
+  return inode_writev_at (file->inode, iov, iovcnt, file_ofs);
+}
+
+/* Copies up to SIZE bytes from IN, starting at IN's current
+   position, to OUT, starting at OUT's current position, without
+   the data ever leaving the kernel.  Whole sectors at matching
+   alignment are copied within the buffer cache.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if the end of either file is reached.  Advances both
+   positions by the number of bytes copied. */
+off_t
+file_copy (struct file *in, struct file *out, off_t size) 
+{
+  off_t bytes_copied;
+
+  ASSERT (in != NULL);
+  ASSERT (out != NULL);
+
+  bytes_copied = inode_copy_at (out->inode, out->pos, in->inode, in->pos,
+                                size);
+
+  in->pos += bytes_copied;
+  out->pos += bytes_copied;
+  return bytes_copied;
+}
+
+/* Writes FILE's buffered data and inode to disk. */
+void
+file_sync (struct file *file) 
+{
+  ASSERT (file != NULL);
+  inode_flush (file->inode);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -2,6 +2,7 @@
 #define FILESYS_FILE_H
 
 #include <stdbool.h>
+#include <uio.h>
 
 #include "filesys/off_t.h"
 
@@ -27,6 +28,16 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, int iovcnt);
+off_t file_writev (struct file *, const struct iovec *, int iovcnt);
+off_t file_readv_at (struct file *, const struct iovec *, int iovcnt,
+                     off_t start);
+off_t file_writev_at (struct file *, const struct iovec *, int iovcnt,
+                      off_t start);
+off_t file_copy (struct file *in, struct file *out, off_t size);
+
+/* Durability. */
+void file_sync (struct file *);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
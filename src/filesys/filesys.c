@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -21,6 +22,7 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
   free_map_init ();
 
@@ -36,6 +38,15 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_flush_all ();
+}
+
+/* Writes every dirty buffered sector to disk, file data before
+   inodes, each in ascending sector order. */
+void
+filesys_sync (void) 
+{
+  cache_flush_all ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -49,8 +60,8 @@ filesys_create (const char *name, off_t initial_size)
   struct dir *dir = dir_open_root ();
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+                  && inode_create (inode_sector, initial_size, false)
+                  && dir_add (dir, name, inode_sector, false));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
@@ -59,6 +70,7 @@ filesys_create (const char *name, off_t initial_size)
 }
 
 /* Opens the file with the given NAME.
+   NAME may be "/" to open the root directory for listing.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,9 +78,13 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  if (!strcmp (name, "/"))
+    return file_open (inode_open (ROOT_DIR_SECTOR));
+
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
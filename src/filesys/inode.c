@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +11,29 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Bytes of file data that fit in the on-disk inode itself. */
+#define INODE_INLINE_SIZE 496
+
+/* Maximum number of sectors moved by one multi-sector request. */
+#define INODE_RUN_MAX 128
+
+/* Inode flags. */
+#define INODE_INLINE 0x1        /* Data is stored in the inode sector. */
+#define INODE_DIR 0x2           /* Inode holds a directory. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Files no longer than INODE_INLINE_SIZE bytes keep their data
+   in INLINE_DATA and own no data sectors at all, so that opening
+   and reading them costs a single sector read. */
 struct inode_disk
   {
     block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint8_t inline_data[INODE_INLINE_SIZE]; /* Data of inline files. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -39,6 +55,13 @@ struct inode
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns true if INODE's data lives in its on-disk inode. */
+static inline bool
+inode_is_inline (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -47,6 +70,7 @@ static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
+  ASSERT (!inode_is_inline (inode));
   if (pos < inode->data.length)
     return inode->data.start + pos / BLOCK_SECTOR_SIZE;
   else
@@ -66,11 +90,11 @@ inode_init (void)
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is marked as a directory if IS_DIR is true.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -87,16 +111,25 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->flags = is_dir ? INODE_DIR : 0;
+      if (length <= INODE_INLINE_SIZE)
         {
-          block_write (fs_device, sector, disk_inode);
+          /* Small enough to keep in the inode sector, which calloc()
+             has already zeroed. */
+          disk_inode->flags |= INODE_INLINE;
+          cache_write (sector, sector, disk_inode);
+          success = true;
+        }
+      else if (free_map_allocate (sectors, &disk_inode->start)) 
+        {
+          cache_write (sector, sector, disk_inode);
           if (sectors > 0) 
             {
               static char zeros[BLOCK_SECTOR_SIZE];
               size_t i;
               
               for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+                cache_write (sector, disk_inode->start + i, zeros);
             }
           success = true; 
         } 
@@ -137,7 +170,7 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  cache_read (inode->sector, &inode->data);
   return inode;
 }
 
@@ -176,15 +209,25 @@ inode_close (struct inode *inode)
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          cache_discard (inode->sector);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (!inode_is_inline (inode))
+            free_map_release (inode->data.start,
+                              bytes_to_sectors (inode->data.length)); 
         }
 
       free (inode); 
     }
 }
 
+/* Writes INODE's dirty data and the inode itself back to disk. */
+void
+inode_flush (struct inode *inode) 
+{
+  ASSERT (inode != NULL);
+  cache_flush (inode->sector);
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
@@ -194,16 +237,152 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Position within a scatter/gather list. */
+struct iov_cursor
+  {
+    const struct iovec *iov;            /* Current segment. */
+    int cnt;                            /* Segments left, including IOV. */
+    size_t ofs;                         /* Byte offset within IOV. */
+  };
+
+/* Initializes C to the start of the CNT segments in IOV. */
+static void
+iov_cursor_init (struct iov_cursor *c, const struct iovec *iov, int cnt)
+{
+  c->iov = iov;
+  c->cnt = cnt;
+  c->ofs = 0;
+}
+
+/* Returns a pointer to C's current position and stores in *LEFT
+   the number of contiguous bytes that follow it.  Exhausted and
+   empty segments are skipped.  Returns a null pointer at the end
+   of the list. */
+static uint8_t *
+iov_cursor_peek (struct iov_cursor *c, size_t *left)
+{
+  while (c->cnt > 0 && c->ofs >= c->iov->iov_len)
+    {
+      c->iov++;
+      c->cnt--;
+      c->ofs = 0;
+    }
+  if (c->cnt == 0)
+    {
+      *left = 0;
+      return NULL;
+    }
+  *left = c->iov->iov_len - c->ofs;
+  return (uint8_t *) c->iov->iov_base + c->ofs;
+}
+
+/* Copies SIZE bytes from SRC to C's position and advances C. */
+static void
+iov_cursor_copy_to (struct iov_cursor *c, const uint8_t *src, size_t size)
+{
+  while (size > 0)
+    {
+      size_t left;
+      uint8_t *dst = iov_cursor_peek (c, &left);
+      size_t n = size < left ? size : left;
+
+      ASSERT (dst != NULL);
+      memcpy (dst, src, n);
+      src += n;
+      size -= n;
+      c->ofs += n;
+    }
+}
+
+/* Copies SIZE bytes from C's position to DST and advances C. */
+static void
+iov_cursor_copy_from (struct iov_cursor *c, uint8_t *dst, size_t size)
+{
+  while (size > 0)
+    {
+      size_t left;
+      const uint8_t *src = iov_cursor_peek (c, &left);
+      size_t n = size < left ? size : left;
+
+      ASSERT (src != NULL);
+      memcpy (dst, src, n);
+      dst += n;
+      size -= n;
+      c->ofs += n;
+    }
+}
+
+/* Returns the total number of bytes in the CNT segments of IOV. */
+static off_t
+iov_length (const struct iovec *iov, int cnt)
+{
+  off_t size = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    size += iov[i].iov_len;
+  return size;
+}
+
+/* Returns the number of whole sectors, up to INODE_RUN_MAX, that
+   can be transferred in one request given SIZE bytes left in the
+   request, INODE_LEFT bytes left in the inode, and CONTIG
+   contiguous bytes left in the caller's current buffer. */
+static block_sector_t
+full_sector_run (off_t size, off_t inode_left, size_t contig) 
+{
+  size_t bytes = size;
+
+  if ((size_t) inode_left < bytes)
+    bytes = inode_left;
+  if (contig < bytes)
+    bytes = contig;
+  bytes /= BLOCK_SECTOR_SIZE;
+  return bytes < INODE_RUN_MAX ? bytes : INODE_RUN_MAX;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  struct iovec iov;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return inode_readv_at (inode, &iov, 1, offset);
+}
+
+/* Reads from INODE into the IOVCNT buffers described by IOV, in
+   order, starting at position OFFSET.  Each sector is read at
+   most once; full sectors that land entirely within one buffer
+   are read directly into it.
+   Returns the number of bytes actually read, which may be less
+   than the total size of IOV if an error occurs or end of file
+   is reached. */
+off_t
+inode_readv_at (struct inode *inode, const struct iovec *iov, int iovcnt,
+                off_t offset) 
 {
-  uint8_t *buffer = buffer_;
+  struct iov_cursor c;
+  off_t size = iov_length (iov, iovcnt);
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  iov_cursor_init (&c, iov, iovcnt);
+
+  if (inode_is_inline (inode))
+    {
+      /* The data was read along with the inode itself. */
+      off_t inode_left = inode_length (inode) - offset;
+      bytes_read = size < inode_left ? size : inode_left;
+      if (bytes_read <= 0)
+        return 0;
+      iov_cursor_copy_to (&c, inode->data.inline_data + offset, bytes_read);
+      return bytes_read;
+    }
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -217,26 +396,42 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      block_sector_t run = 0;
+      size_t contig;
+      uint8_t *dst;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      dst = iov_cursor_peek (&c, &contig);
+      if (sector_ofs == 0)
+        run = full_sector_run (size, inode_left, contig);
+      if (run > 1)
+        {
+          /* Read a run of full sectors directly into caller's
+             buffer with a single request. */
+          chunk_size = run * BLOCK_SECTOR_SIZE;
+          cache_read_multiple (sector_idx, run, dst);
+          c.ofs += chunk_size;
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+               && contig >= BLOCK_SECTOR_SIZE)
         {
           /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          cache_read (sector_idx, dst);
+          c.ofs += BLOCK_SECTOR_SIZE;
         }
       else 
         {
           /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
+             into caller's buffers. */
           if (bounce == NULL) 
             {
               bounce = malloc (BLOCK_SECTOR_SIZE);
               if (bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          cache_read (sector_idx, bounce);
+          iov_cursor_copy_to (&c, bounce + sector_ofs, chunk_size);
         }
       
       /* Advance. */
@@ -255,16 +450,51 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
    (Normally a write at end of file would extend the inode, but
    growth is not yet implemented.) */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
 {
-  const uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return inode_writev_at (inode, &iov, 1, offset);
+}
+
+/* Writes the IOVCNT buffers described by IOV into INODE, in
+   order, starting at OFFSET.  Each sector is written at most
+   once; full sectors that come entirely from one buffer are
+   written directly from it.
+   Returns the number of bytes actually written, which may be
+   less than the total size of IOV if end of file is reached or
+   an error occurs. */
+off_t
+inode_writev_at (struct inode *inode, const struct iovec *iov, int iovcnt,
+                 off_t offset) 
+{
+  struct iov_cursor c;
+  off_t size = iov_length (iov, iovcnt);
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  iov_cursor_init (&c, iov, iovcnt);
+
+  if (inode_is_inline (inode))
+    {
+      /* Update the in-memory copy and write back the whole inode
+         sector. */
+      off_t inode_left = inode_length (inode) - offset;
+      bytes_written = size < inode_left ? size : inode_left;
+      if (bytes_written <= 0)
+        return 0;
+      iov_cursor_copy_from (&c, inode->data.inline_data + offset,
+                            bytes_written);
+      cache_write (inode->sector, inode->sector, &inode->data);
+      return bytes_written;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -278,13 +508,29 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      block_sector_t run = 0;
+      size_t contig;
+      const uint8_t *src;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      src = iov_cursor_peek (&c, &contig);
+      if (sector_ofs == 0)
+        run = full_sector_run (size, inode_left, contig);
+      if (run > 1)
+        {
+          /* Write a run of full sectors directly from caller's
+             buffer with a single request. */
+          chunk_size = run * BLOCK_SECTOR_SIZE;
+          cache_write_multiple (inode->sector, sector_idx, run, src);
+          c.ofs += chunk_size;
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+               && contig >= BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write full sector directly from caller's buffer. */
+          cache_write (inode->sector, sector_idx, src);
+          c.ofs += BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -300,11 +546,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
           if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+            cache_read (sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          iov_cursor_copy_from (&c, bounce + sector_ofs, chunk_size);
+          cache_write (inode->sector, sector_idx, bounce);
         }
 
       /* Advance. */
@@ -317,6 +563,75 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Copies SIZE bytes from SRC, starting at SRC_OFS, to DST,
+   starting at DST_OFS.  Whole sectors at the same alignment in
+   both inodes are copied from cache entry to cache entry; the
+   partial sectors at either end, and everything when the two
+   offsets are differently aligned or either inode is inline, go
+   through a one-sector bounce buffer.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if the end of either inode is reached or an error
+   occurs. */
+off_t
+inode_copy_at (struct inode *dst, off_t dst_ofs,
+               struct inode *src, off_t src_ofs, off_t size) 
+{
+  off_t bytes_copied = 0;
+  uint8_t *bounce = NULL;
+
+  if (dst->deny_write_cnt)
+    return 0;
+
+  while (size > 0) 
+    {
+      /* Bytes left in each inode, bytes left in each sector, and
+         the least of those. */
+      off_t src_left = inode_length (src) - src_ofs;
+      off_t dst_left = inode_length (dst) - dst_ofs;
+      int src_sector_left = BLOCK_SECTOR_SIZE - src_ofs % BLOCK_SECTOR_SIZE;
+      int dst_sector_left = BLOCK_SECTOR_SIZE - dst_ofs % BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size;
+
+      if (src_left < chunk_size)
+        chunk_size = src_left;
+      if (dst_left < chunk_size)
+        chunk_size = dst_left;
+      if (src_sector_left < chunk_size)
+        chunk_size = src_sector_left;
+      if (dst_sector_left < chunk_size)
+        chunk_size = dst_sector_left;
+      if (chunk_size <= 0)
+        break;
+
+      if (chunk_size == BLOCK_SECTOR_SIZE
+          && !inode_is_inline (src) && !inode_is_inline (dst))
+        cache_copy (dst->sector, byte_to_sector (dst, dst_ofs),
+                    byte_to_sector (src, src_ofs));
+      else 
+        {
+          if (bounce == NULL) 
+            {
+              bounce = malloc (BLOCK_SECTOR_SIZE);
+              if (bounce == NULL)
+                break;
+            }
+          if (inode_read_at (src, bounce, chunk_size, src_ofs) != chunk_size
+              || inode_write_at (dst, bounce, chunk_size, dst_ofs)
+                 != chunk_size)
+            break;
+        }
+
+      /* Advance. */
+      size -= chunk_size;
+      src_ofs += chunk_size;
+      dst_ofs += chunk_size;
+      bytes_copied += chunk_size;
+    }
+  free (bounce);
+
+  return bytes_copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -337,6 +652,13 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
@@ -0,0 +1,28 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entry records, shared by the kernel and user
+   programs for the getdents() system call. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* One directory entry as packed by getdents().  Records are
+   variable-length: D_NAME is null-terminated and the next
+   record starts D_RECLEN bytes after this one. */
+struct dirent
+  {
+    uint32_t d_ino;             /* Inode number. */
+    uint16_t d_reclen;          /* Length of this record in bytes. */
+    bool d_is_dir;              /* Is this entry a directory? */
+    char d_name[1];             /* File name, null-terminated. */
+  };
+
+/* Returns the record length of a struct dirent whose name is
+   NAME_LEN bytes long, rounded up to keep records aligned. */
+#define DIRENT_RECLEN(NAME_LEN)                                 \
+        ((offsetof (struct dirent, d_name) + (NAME_LEN) + 1     \
+          + sizeof (uint32_t) - 1) & ~(sizeof (uint32_t) - 1))
+
+#endif /* lib/dirent.h */
@@ -1,14 +1,21 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
 #include "devices/serial.h"
+#include "devices/timer.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
 
 static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+static void log_append (const char *, size_t);
+static bool log_print_chunk (void);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -59,6 +66,54 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* Kernel log.
+
+   Output from printf(), puts(), and putchar() goes into an
+   in-memory ring, not straight to the console, so that logging
+   does not hold up the caller while the serial port sends it.
+   A low-priority work item, log_flush_work, prints the ring to
+   the console in the background on the kernel's shared worker
+   threads.  Text stays in the ring after it has been
+   printed, until it is overwritten, and console_read_log() reads
+   it back along with the time each line was logged.
+
+   Appending only disables interrupts while it copies, so it
+   never waits and may be done from an interrupt handler.  Text
+   is printed from the ring with interrupts off, a chunk at a
+   time, so that concurrent flushes cannot reorder it.  A single
+   vprintf() call is appended in pieces of up to VPRINTF_CHUNK
+   bytes, so very long messages from different threads can
+   interleave.
+
+   putbuf(), which user programs use to write to the console,
+   writes straight out, but first flushes the ring so that the
+   console shows everything in the order it was produced.  So
+   does a kernel panic, after which all output is synchronous. */
+#define LOG_SIZE 32768                  /* Bytes of text, power of 2. */
+#define LOG_LINES 1024                  /* Lines of text, power of 2. */
+#define LOG_PRINT_CHUNK 256             /* Bytes printed at a time. */
+
+static char log_text[LOG_SIZE];         /* Text ring. */
+static unsigned long long log_head;     /* Bytes ever logged. */
+static unsigned long long log_printed;  /* Bytes printed to console. */
+
+/* Start of a line in the log. */
+struct log_line
+  {
+    unsigned long long start;           /* Offset of first byte. */
+    int64_t time;                       /* timer_ticks() when logged. */
+  };
+static struct log_line log_lines[LOG_LINES]; /* Line ring. */
+static unsigned long long log_line_cnt; /* Lines ever started. */
+static bool log_mid_line;               /* Last byte was not new-line? */
+
+/* True when a work item prints logged text.  False during early
+   boot, before the work queue starts, and after a panic, when
+   text is printed as soon as it is logged. */
+static bool log_deferred;
+static struct work log_flush_work;      /* Prints logged text. */
+static work_func log_flusher;
+
 /* Enable console locking. */
 void
 console_init (void) 
@@ -67,13 +122,40 @@ console_init (void)
   use_console_lock = true;
 }
 
+/* Starts printing the kernel log to the console from the work
+   queue, which must be initialized.  Until this is called,
+   logged text is printed synchronously. */
+void
+console_start_flusher (void) 
+{
+  work_init (&log_flush_work, log_flusher, NULL, WORK_LOW);
+  log_deferred = true;
+}
+
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
-   now on. */
+   now on.  Flushes the kernel log and makes further output
+   synchronous, so that nothing the panic prints can be lost. */
 void
 console_panic (void) 
 {
   use_console_lock = false;
+  log_deferred = false;
+  console_flush ();
+}
+
+/* Prints whatever is in the kernel log and not yet printed. */
+void
+console_flush (void) 
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      bool more = log_print_chunk ();
+      intr_set_level (old_level);
+      if (!more)
+        break;
+    }
 }
 
 /* Prints console statistics. */
@@ -119,73 +201,246 @@ console_locked_by_current_thread (void)
           || lock_held_by_current_thread (&console_lock));
 }
 
+/* Output of vprintf() that has not yet been logged.  It is
+   collected in BUF so that it can be appended to the log a
+   chunk at a time. */
+#define VPRINTF_CHUNK 128
+struct vprintf_buf
+  {
+    int char_cnt;               /* Number of characters so far. */
+    size_t len;                 /* Number of bytes in BUF. */
+    char buf[VPRINTF_CHUNK];    /* Characters not yet logged. */
+  };
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
-   Writes its output to both vga display and serial port. */
+   Appends its output to the kernel log, which is printed to
+   both vga display and serial port. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_buf vb;
 
-  acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
-  release_console ();
+  vb.char_cnt = 0;
+  vb.len = 0;
+  __vprintf (format, args, vprintf_helper, &vb);
+  log_append (vb.buf, vb.len);
 
-  return char_cnt;
+  return vb.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
-   character. */
+   character, by way of the kernel log. */
 int
 puts (const char *s) 
 {
-  acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
-  release_console ();
+  log_append (s, strlen (s));
+  log_append ("\n", 1);
 
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console, after
+   anything still waiting in the kernel log. */
 void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  console_flush ();
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
-/* Writes C to the vga display and serial port. */
+/* Writes C to the console, by way of the kernel log. */
 int
 putchar (int c) 
 {
-  acquire_console ();
-  putchar_have_lock (c);
-  release_console ();
+  char ch = c;
+  log_append (&ch, 1);
   
   return c;
 }
-
+
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *vb_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_buf *vb = vb_;
+
+  vb->char_cnt++;
+  vb->buf[vb->len++] = c;
+  if (vb->len >= sizeof vb->buf)
+    {
+      log_append (vb->buf, vb->len);
+      vb->len = 0;
+    }
 }
 
-/* Writes C to the vga display and serial port.
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, passing them to the serial port all at once.
    The caller has already acquired the console lock if
    appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  write_cnt += n;
+  serial_putbuf (buffer, n);
+  while (n-- > 0)
+    vga_putc (*buffer++);
+}
+
+/* Appends the N characters in BUFFER to the kernel log, then
+   either prints them or arranges for the flusher to. */
+static void
+log_append (const char *buffer, size_t n) 
+{
+  enum intr_level old_level;
+  int64_t now;
+
+  if (n == 0)
+    return;
+
+  now = timer_ticks ();
+  old_level = intr_disable ();
+  while (n-- > 0)
+    {
+      char c = *buffer++;
+
+      /* If the flusher has fallen a whole ring behind, print
+         the oldest text ourselves to make room. */
+      if (log_head - log_printed == LOG_SIZE)
+        log_print_chunk ();
+
+      if (!log_mid_line)
+        {
+          struct log_line *line = &log_lines[log_line_cnt++ % LOG_LINES];
+          line->start = log_head;
+          line->time = now;
+        }
+      log_text[log_head++ % LOG_SIZE] = c;
+      log_mid_line = c != '\n';
+    }
+
+  if (!log_deferred)
+    {
+      while (log_print_chunk ())
+        continue;
+    }
+  else if (intr_context () || old_level == INTR_ON)
+    {
+      /* Don't queue the flusher from a thread that turned off
+         interrupts, because work_queue() might switch to a worker
+         in the middle of whatever the caller needed interrupts
+         off for.  The text will be printed after the next time it
+         is queued. */
+      work_queue (&log_flush_work);
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints up to LOG_PRINT_CHUNK bytes of logged text that has not
+   yet been printed.  Returns true if there may be more to print,
+   false if there is none.  Interrupts must be off, so that
+   chunks are printed in order. */
+static bool
+log_print_chunk (void) 
+{
+  size_t ofs = log_printed % LOG_SIZE;
+  size_t n = log_head - log_printed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (n == 0)
+    return false;
+  if (n > LOG_SIZE - ofs)
+    n = LOG_SIZE - ofs;
+  if (n > LOG_PRINT_CHUNK)
+    n = LOG_PRINT_CHUNK;
+
+  write_cnt += n;
+  serial_putbuf (log_text + ofs, n);
+  log_printed += n;
+  while (n-- > 0)
+    vga_putc (log_text[ofs++]);
+  return true;
+}
+
+/* Work function that prints the kernel log.  Queued whenever
+   text is appended to it. */
+static void
+log_flusher (void *aux UNUSED) 
+{
+  console_flush ();
+}
+
+/* Formats the time stamp for LINE into PREFIX, which must have
+   room for PREFIX_SIZE bytes, and returns its length. */
+static size_t
+format_time_stamp (const struct log_line *line, char *prefix,
+                   size_t prefix_size) 
+{
+  return snprintf (prefix, prefix_size, "[%5"PRId64".%02d] ",
+                   line->time / TIMER_FREQ,
+                   (int) (line->time % TIMER_FREQ * 100 / TIMER_FREQ));
+}
+
+/* Returns the offset just past the end of line number I in the
+   kernel log. */
+static unsigned long long
+line_end (unsigned long long i) 
+{
+  return (i + 1 < log_line_cnt
+          ? log_lines[(i + 1) % LOG_LINES].start
+          : log_head);
+}
+
+/* Copies as many of the most recent lines in the kernel log as
+   fit into BUFFER, which has room for SIZE bytes, oldest first.
+   Each line is prefixed by the time at which it was logged, in
+   the form "[SECONDS.HUNDREDTHS] ".  Returns the number of bytes
+   copied. */
+size_t
+console_read_log (char *buffer, size_t size) 
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned long long first, i, oldest_text;
+  size_t total = 0;
+  char prefix[32];
+
+  /* Lines whose text has been partly overwritten are gone. */
+  oldest_text = log_head > LOG_SIZE ? log_head - LOG_SIZE : 0;
+  first = log_line_cnt > LOG_LINES ? log_line_cnt - LOG_LINES : 0;
+  while (first < log_line_cnt
+         && log_lines[first % LOG_LINES].start < oldest_text)
+    first++;
+
+  /* Find the oldest line such that it and all the lines after it
+     fit in BUFFER. */
+  for (i = log_line_cnt; i > first; i--)
+    {
+      const struct log_line *line = &log_lines[(i - 1) % LOG_LINES];
+      size_t len = (format_time_stamp (line, prefix, sizeof prefix)
+                    + (line_end (i - 1) - line->start));
+      if (total + len > size)
+        break;
+      total += len;
+    }
+
+  /* Copy them. */
+  total = 0;
+  for (; i < log_line_cnt; i++)
+    {
+      const struct log_line *line = &log_lines[i % LOG_LINES];
+      unsigned long long pos, end = line_end (i);
+      size_t len = format_time_stamp (line, prefix, sizeof prefix);
+
+      memcpy (buffer + total, prefix, len);
+      total += len;
+      for (pos = line->start; pos < end; pos++)
+        buffer[total++] = log_text[pos % LOG_SIZE];
+    }
+  intr_set_level (old_level);
+
+  return total;
 }
@@ -1,8 +1,13 @@
 #ifndef __LIB_KERNEL_CONSOLE_H
 #define __LIB_KERNEL_CONSOLE_H
 
+#include <stddef.h>
+
 void console_init (void);
+void console_start_flusher (void);
 void console_panic (void);
+void console_flush (void);
 void console_print_stats (void);
+size_t console_read_log (char *, size_t);
 
 #endif /* lib/kernel/console.h */
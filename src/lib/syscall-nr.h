@@ -28,7 +28,23 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PREAD,                  /* Read from a file at a given offset. */
+    SYS_PWRITE,                 /* Write to a file at a given offset. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write to a file from several buffers. */
+    SYS_COPY_FILE_RANGE,        /* Copy data between two files. */
+    SYS_FSYNC,                  /* Write a file's buffered data to disk. */
+    SYS_SYNC,                   /* Write all buffered data to disk. */
+    SYS_GETDENTS,               /* Reads a batch of directory entries. */
+    SYS_DMESG,                  /* Reads the kernel log. */
+    SYS_FUTEX_WAIT,             /* Sleeps on a futex. */
+    SYS_FUTEX_WAKE,             /* Wakes threads sleeping on a futex. */
+    SYS_THREAD_CREATE,          /* Starts a thread in this process. */
+    SYS_THREAD_JOIN,            /* Waits for a thread to exit. */
+    SYS_THREAD_EXIT             /* Terminates the calling thread. */
   };
 
 #endif /* lib/syscall-nr.h */
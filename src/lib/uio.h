@@ -0,0 +1,19 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+/* Scatter/gather I/O vectors, shared by the kernel and user
+   programs for the readv() and writev() system calls. */
+
+#include <stddef.h>
+
+/* Maximum number of segments accepted by readv() and writev(). */
+#define IOV_MAX 16
+
+/* One segment of a scatter/gather buffer. */
+struct iovec
+  {
+    void *iov_base;             /* Start of segment. */
+    size_t iov_len;             /* Length of segment in bytes. */
+  };
+
+#endif /* lib/uio.h */
@@ -0,0 +1,42 @@
+#include <pthread.h>
+#include <syscall.h>
+
+/* Runs in a new thread: calls START with ARG and exits the thread
+   with its return value, since there is nowhere to return to. */
+static void
+pthread_stub (void *(*start) (void *), void *arg) 
+{
+  thread_exit (start (arg));
+}
+
+/* Starts a thread that runs START (ARG) and stores its identifier
+   in *THREAD.  Returns 0 if successful, -1 on failure. */
+int
+pthread_create (pthread_t *thread, void *(*start) (void *), void *arg) 
+{
+  tid_t tid = thread_create (pthread_stub, start, arg);
+
+  if (tid == TID_ERROR)
+    return -1;
+  *thread = tid;
+  return 0;
+}
+
+/* Waits for THREAD to exit and, if RETVAL is nonnull, stores the
+   value it returned or passed to pthread_exit() in *RETVAL.  Each
+   thread may be joined only once.  Returns 0 if successful, -1 on
+   failure. */
+int
+pthread_join (pthread_t thread, void **retval) 
+{
+  return thread_join (thread, retval);
+}
+
+/* Terminates the calling thread with RETVAL for pthread_join().
+   In the thread that runs main(), first waits for the others to
+   exit and then exits the process with status 0. */
+void
+pthread_exit (void *retval) 
+{
+  thread_exit (retval);
+}
@@ -0,0 +1,20 @@
+#ifndef __LIB_USER_PTHREAD_H
+#define __LIB_USER_PTHREAD_H
+
+#include <debug.h>
+#include <syscall.h>
+
+/* POSIX-style threads.
+
+   The threads of a process share its address space and its file
+   descriptors, and each runs on a stack of its own of up to
+   256 kB.  Use the mutexes and condition variables in synch.h to
+   synchronize them.  Calling exit() in any thread, or returning
+   from main(), exits the whole process. */
+typedef tid_t pthread_t;
+
+int pthread_create (pthread_t *, void *(*start) (void *), void *arg);
+int pthread_join (pthread_t, void **retval);
+void pthread_exit (void *retval) NO_RETURN;
+
+#endif /* lib/user/pthread.h */
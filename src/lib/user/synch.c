@@ -0,0 +1,135 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* Mutexes and condition variables built on futexes, following
+   Ulrich Drepper, "Futexes Are Tricky". */
+
+/* Atomically replaces *P by NEW if it equals OLD.  Returns the
+   previous value of *P. */
+static inline int
+compare_exchange (int *p, int old, int new) 
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p) : "r" (new) : "memory");
+  return old;
+}
+
+/* Atomically replaces *P by NEW.  Returns the previous value of
+   *P. */
+static inline int
+exchange (int *p, int new) 
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically adds N to *P.  Returns the previous value of *P. */
+static inline int
+fetch_add (int *p, int n) 
+{
+  asm volatile ("lock xaddl %0, %1" : "+r" (n), "+m" (*p) : : "memory");
+  return n;
+}
+
+/* Initializes M as an unlocked mutex. */
+void
+mutex_init (struct mutex *m) 
+{
+  m->state = 0;
+}
+
+/* Locks M, sleeping until it is available if necessary.  M must
+   not already be held by the calling thread. */
+void
+mutex_lock (struct mutex *m) 
+{
+  int c = compare_exchange (&m->state, 0, 1);
+  if (c != 0)
+    {
+      /* Contended.  Mark M as having sleepers, so that unlocking
+         it wakes one, and sleep until it is unlocked. */
+      if (c != 2)
+        c = exchange (&m->state, 2);
+      while (c != 0)
+        {
+          futex_wait (&m->state, 2);
+          c = exchange (&m->state, 2);
+        }
+    }
+}
+
+/* Locks M if it is available.  Returns true if successful,
+   false if M is held by some thread. */
+bool
+mutex_trylock (struct mutex *m) 
+{
+  return compare_exchange (&m->state, 0, 1) == 0;
+}
+
+/* Unlocks M, which the calling thread must hold, waking a thread
+   sleeping on it if there might be one. */
+void
+mutex_unlock (struct mutex *m) 
+{
+  if (fetch_add (&m->state, -1) != 1)
+    {
+      exchange (&m->state, 0);
+      futex_wake (&m->state, 1);
+    }
+}
+
+/* Initializes C as a condition variable with no waiters. */
+void
+cond_init (struct cond *c) 
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+/* Atomically unlocks M and waits for C to be signaled, then locks
+   M again.  M must be held by the calling thread.  As with any
+   condition variable, the caller must recheck its condition after
+   waking up. */
+void
+cond_wait (struct cond *c, struct mutex *m) 
+{
+  int seq = c->seq;
+
+  fetch_add (&c->waiters, 1);
+  mutex_unlock (m);
+
+  /* If a signal came after unlocking M, SEQ is stale and this
+     returns at once. */
+  futex_wait (&c->seq, seq);
+  fetch_add (&c->waiters, -1);
+
+  /* Relock M as contended, because other woken waiters may be
+     sleeping on it. */
+  while (exchange (&m->state, 2) != 0)
+    futex_wait (&m->state, 2);
+}
+
+/* Wakes one thread waiting on C, if any.  The mutex used with C
+   should be held, so that the count of waiters is exact. */
+void
+cond_signal (struct cond *c) 
+{
+  if (c->waiters > 0)
+    {
+      fetch_add (&c->seq, 1);
+      futex_wake (&c->seq, 1);
+    }
+}
+
+/* Wakes all threads waiting on C.  The mutex used with C should
+   be held, as for cond_signal(). */
+void
+cond_broadcast (struct cond *c) 
+{
+  if (c->waiters > 0)
+    {
+      fetch_add (&c->seq, 1);
+      futex_wake (&c->seq, INT_MAX);
+    }
+}
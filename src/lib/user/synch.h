@@ -0,0 +1,40 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutex.
+
+   Locking and unlocking a mutex that no other thread is using
+   takes no system calls: the kernel is entered only to sleep
+   while another thread holds the mutex, and to wake a sleeper on
+   unlocking. */
+struct mutex
+  {
+    int state;                  /* 0: unlocked, 1: locked,
+                                   2: locked, maybe with sleepers. */
+  };
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable.  Signaling a condition variable that no
+   thread waits on takes no system calls. */
+struct cond
+  {
+    int seq;                    /* Incremented by each signal. */
+    int waiters;                /* Number of waiting threads. */
+  };
+
+#define COND_INITIALIZER { 0, 0 }
+
+void cond_init (struct cond *);
+void cond_wait (struct cond *, struct mutex *);
+void cond_signal (struct cond *);
+void cond_broadcast (struct cond *);
+
+#endif /* lib/user/synch.h */
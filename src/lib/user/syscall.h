@@ -3,11 +3,17 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -45,4 +51,21 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+bool fsync (int fd);
+void sync (void);
+int getdents (int fd, struct dirent *buffer, unsigned size);
+int dmesg (char *buffer, unsigned size);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int cnt);
+tid_t thread_create (void (*stub) (void *(*) (void *), void *),
+                     void *(*start) (void *), void *arg);
+int thread_join (tid_t, void **result);
+void thread_exit (void *result) NO_RETURN;
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,51 @@
+/* The main thread acquires a readers-writer lock for reading and
+   upgrades it to writing, which should succeed without any other
+   writer getting in.  Then it creates a higher-priority reader,
+   which must wait and donate its priority.  When the main thread
+   downgrades back to reading, the reader should get the lock
+   alongside it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread_func;
+
+void
+test_rwlock_upgrade (void) 
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rwlock_acquire_read (&rw);
+  msg ("Upgrade should succeed: %s.",
+       rwlock_upgrade (&rw) ? "succeeded" : "failed");
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread_func, &rw);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  rwlock_downgrade (&rw);
+  msg ("reader must already have finished.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  rwlock_release_read (&rw);
+  msg ("This should be the last line before finishing this test.");
+}
+
+static void
+reader_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_acquire_read (rw);
+  msg ("reader: got the lock");
+  rwlock_release_read (rw);
+  msg ("reader: done");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-upgrade) begin
+(rwlock-upgrade) Upgrade should succeed: succeeded.
+(rwlock-upgrade) This thread should have priority 32.  Actual priority: 32.
+(rwlock-upgrade) reader: got the lock
+(rwlock-upgrade) reader: done
+(rwlock-upgrade) reader must already have finished.
+(rwlock-upgrade) This thread should have priority 31.  Actual priority: 31.
+(rwlock-upgrade) This should be the last line before finishing this test.
+(rwlock-upgrade) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* The main thread acquires a readers-writer lock for reading.
+   Then it creates a higher-priority writer, which must wait for
+   the main thread to finish reading, and a reader with higher
+   priority still, which must wait behind the writer and donate
+   its priority to it.  When the main thread stops reading, the
+   writer and then the reader should get the lock. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+
+static struct rwlock rw;
+static struct thread *writer;
+
+void
+test_rwlock_writer (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rwlock_acquire_read (&rw);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread_func, NULL);
+  msg ("The writer should be waiting.");
+  thread_create ("reader", PRI_DEFAULT + 2, reader_thread_func, NULL);
+  msg ("The writer should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, get_priority (writer));
+  rwlock_release_read (&rw);
+  msg ("writer, reader must already have finished, in that order.");
+  msg ("This should be the last line before finishing this test.");
+}
+
+static void
+writer_thread_func (void *aux UNUSED) 
+{
+  writer = thread_current ();
+  rwlock_acquire_write (&rw);
+  msg ("writer: got the lock");
+  rwlock_release_write (&rw);
+  msg ("writer: done");
+}
+
+static void
+reader_thread_func (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  msg ("reader: got the lock");
+  rwlock_release_read (&rw);
+  msg ("reader: done");
+}
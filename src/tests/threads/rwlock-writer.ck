@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer) begin
+(rwlock-writer) The writer should be waiting.
+(rwlock-writer) The writer should have priority 33.  Actual priority: 33.
+(rwlock-writer) writer: got the lock
+(rwlock-writer) reader: got the lock
+(rwlock-writer) reader: done
+(rwlock-writer) writer: done
+(rwlock-writer) writer, reader must already have finished, in that order.
+(rwlock-writer) This should be the last line before finishing this test.
+(rwlock-writer) end
+EOF
+pass;
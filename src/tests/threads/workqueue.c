@@ -0,0 +1,111 @@
+/* Queues work items of each priority while the workers cannot
+   run and cancels one, then checks that the others run highest
+   priority first.  Then checks that a delayed item runs once its
+   delay is over, and that a cancelled delayed item never runs.
+   Finally checks that a high-priority item runs at once while the
+   main thread spins, even though every worker last ran a
+   low-priority item. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+static work_func record;
+static work_func wait_gate;
+static work_func note_high;
+
+static struct semaphore done;
+static const char *order[4];
+static int order_cnt;
+
+static struct semaphore gate;
+static volatile bool high_ran;
+
+void
+test_workqueue (void) 
+{
+  struct work low, normal, high, delayed, cancelled;
+  struct work gated[2], urgent;
+  int64_t start;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+  work_init (&low, record, "low", WORK_LOW);
+  work_init (&normal, record, "normal", WORK_NORMAL);
+  work_init (&high, record, "high", WORK_HIGH);
+  work_init (&delayed, record, "delayed", WORK_NORMAL);
+  work_init (&cancelled, record, "cancelled", WORK_HIGH);
+
+  /* Keep the workers from running until everything is queued. */
+  thread_set_priority (PRI_MAX);
+  work_queue (&low);
+  work_queue (&normal);
+  work_queue (&high);
+  if (!work_cancel (&normal))
+    fail ("work_cancel() did not find a queued item");
+  if (work_cancel (&normal))
+    fail ("work_cancel() found an item that is not queued");
+  thread_set_priority (PRI_DEFAULT);
+  sema_down (&done);
+  sema_down (&done);
+
+  work_queue_delayed (&delayed, 2);
+  if (!work_pending (&delayed) || work_queue (&delayed))
+    fail ("delayed item is not pending");
+  work_queue_delayed (&cancelled, 1);
+  work_cancel_sync (&cancelled);
+  sema_down (&done);
+  timer_sleep (2);
+
+  for (i = 0; i < order_cnt; i++)
+    msg ("ran %s", order[i]);
+
+  /* Give each worker a low-priority item that blocks, so that
+     both run one, then let them finish and go idle. */
+  sema_init (&gate, 0);
+  for (i = 0; i < 2; i++)
+    {
+      work_init (&gated[i], wait_gate, NULL, WORK_LOW);
+      work_queue (&gated[i]);
+    }
+  timer_sleep (1);
+  sema_up (&gate);
+  sema_up (&gate);
+  timer_sleep (2);
+
+  /* Spin above the workers' low priority. */
+  work_init (&urgent, note_high, NULL, WORK_HIGH);
+  start = timer_ticks ();
+  work_queue (&urgent);
+  while (!high_ran && timer_elapsed (start) < 10)
+    continue;
+  if (!high_ran)
+    fail ("high-priority item did not run while the main thread spun");
+  msg ("high-priority item ran while the main thread spun");
+}
+
+static void
+record (void *name) 
+{
+  order[order_cnt++] = name;
+  sema_up (&done);
+}
+
+static void
+wait_gate (void *aux UNUSED) 
+{
+  sema_down (&gate);
+}
+
+static void
+note_high (void *aux UNUSED) 
+{
+  high_ran = true;
+}
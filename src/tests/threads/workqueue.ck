@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) ran high
+(workqueue) ran low
+(workqueue) ran delayed
+(workqueue) high-priority item ran while the main thread spun
+(workqueue) end
+EOF
+pass;
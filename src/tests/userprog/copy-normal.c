@@ -0,0 +1,27 @@
+/* Copies a file with copy_file_range() and verifies the copy. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int in_fd, out_fd, byte_cnt;
+
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", sizeof sample - 1), "create \"copy.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+
+  byte_cnt = copy_file_range (in_fd, out_fd, sizeof sample - 1);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("copy_file_range() returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1);
+  if (tell (in_fd) != sizeof sample - 1 || tell (out_fd) != sizeof sample - 1)
+    fail ("copy_file_range() did not advance file positions");
+
+  msg ("close \"copy.txt\"");
+  close (out_fd);
+  check_file ("copy.txt", sample, sizeof sample - 1);
+}
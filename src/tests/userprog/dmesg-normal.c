@@ -0,0 +1,27 @@
+/* Reads the kernel log and checks that it holds the message the
+   kernel printed just before running this test, time-stamped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* The kernel only fills the page that its buffer starts in. */
+static char buf[4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void) 
+{
+  const char *line;
+  int n;
+
+  n = dmesg (buf, sizeof buf - 1);
+  CHECK (n > 0, "dmesg");
+  buf[n] = '\0';
+
+  line = strstr (buf, "Executing 'dmesg-normal':\n");
+  if (line == NULL)
+    fail ("test's startup message not in kernel log");
+  if (line - buf < 2 || line[-1] != ' ' || line[-2] != ']')
+    fail ("kernel log line not time-stamped");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dmesg-normal) begin
+(dmesg-normal) dmesg
+(dmesg-normal) end
+dmesg-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Writes a file, forces it to disk with fsync() and sync(), and
+   verifies that the data reads back correctly. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", sizeof sample - 1), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = write (handle, sample, sizeof sample - 1);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("write() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  CHECK (fsync (handle), "fsync \"test.txt\"");
+  msg ("sync");
+  sync ();
+
+  msg ("close \"test.txt\"");
+  close (handle);
+  check_file ("test.txt", sample, sizeof sample - 1);
+}
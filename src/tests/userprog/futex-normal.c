@@ -0,0 +1,26 @@
+/* Checks the futex system calls' handling of a futex that holds
+   an unexpected value or has no sleepers, and locks and unlocks a
+   mutex built on futexes without contention. */
+
+#include <synch.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word = 5;
+static struct mutex mutex = MUTEX_INITIALIZER;
+static struct cond cond = COND_INITIALIZER;
+
+void
+test_main (void) 
+{
+  CHECK (futex_wait (&word, 6) == -1, "futex_wait on changed futex");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no sleepers");
+
+  mutex_lock (&mutex);
+  CHECK (!mutex_trylock (&mutex), "mutex_trylock on locked mutex");
+  cond_signal (&cond);
+  mutex_unlock (&mutex);
+  CHECK (mutex_trylock (&mutex), "mutex_trylock on unlocked mutex");
+  mutex_unlock (&mutex);
+}
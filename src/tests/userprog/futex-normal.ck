@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-normal) begin
+(futex-normal) futex_wait on changed futex
+(futex-normal) futex_wake with no sleepers
+(futex-normal) mutex_trylock on locked mutex
+(futex-normal) mutex_trylock on unlocked mutex
+(futex-normal) end
+futex-normal: exit(0)
+EOF
+pass;
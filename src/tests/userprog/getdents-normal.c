@@ -0,0 +1,48 @@
+/* Lists the root directory with getdents() and checks that the
+   expected files show up exactly once. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char *names[] = {"sample.txt", "a.txt", "b.txt"};
+  int found[3] = {0, 0, 0};
+  char buf[512];
+  int handle, byte_cnt;
+  size_t i;
+
+  CHECK (create ("a.txt", 0), "create \"a.txt\"");
+  CHECK (create ("b.txt", 0), "create \"b.txt\"");
+  CHECK ((handle = open ("/")) > 1, "open \"/\"");
+
+  while ((byte_cnt = getdents (handle, (struct dirent *) buf, sizeof buf)) > 0)
+    {
+      int ofs = 0;
+      while (ofs < byte_cnt)
+        {
+          struct dirent *d = (struct dirent *) (buf + ofs);
+          if (d->d_is_dir)
+            fail ("\"%s\" reported as a directory", d->d_name);
+          for (i = 0; i < sizeof names / sizeof *names; i++)
+            if (!strcmp (d->d_name, names[i]))
+              found[i]++;
+          ofs += d->d_reclen;
+        }
+    }
+  if (byte_cnt < 0)
+    fail ("getdents() returned %d", byte_cnt);
+
+  for (i = 0; i < sizeof names / sizeof *names; i++)
+    if (found[i] != 1)
+      fail ("\"%s\" listed %d times", names[i], found[i]);
+  msg ("listed all files");
+
+  CHECK (write (handle, buf, 1) == -1, "write to directory fails");
+
+  msg ("close \"/\"");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents-normal) begin
+(getdents-normal) create "a.txt"
+(getdents-normal) create "b.txt"
+(getdents-normal) open "/"
+(getdents-normal) listed all files
+(getdents-normal) write to directory fails
+(getdents-normal) close "/"
+(getdents-normal) end
+getdents-normal: exit(0)
+EOF
+pass;
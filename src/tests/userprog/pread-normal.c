@@ -0,0 +1,33 @@
+/* Reads part of a file with pread() and checks that the data is
+   correct and that the file position did not move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[64];
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  byte_cnt = pread (handle, buf, sizeof buf, 100);
+  if (byte_cnt != sizeof buf)
+    fail ("pread() returned %d instead of %zu", byte_cnt, sizeof buf);
+  if (memcmp (buf, sample + 100, sizeof buf))
+    fail ("pread() returned wrong data");
+
+  if (tell (handle) != 0)
+    fail ("pread() moved file position to %u", tell (handle));
+
+  byte_cnt = pread (handle, buf, sizeof buf, sizeof sample - 11);
+  if (byte_cnt != 10)
+    fail ("pread() at end of file returned %d instead of 10", byte_cnt);
+
+  msg ("close \"sample.txt\"");
+  close (handle);
+}
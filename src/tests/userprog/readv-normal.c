@@ -0,0 +1,42 @@
+/* Reads a file into three buffers with a single readv() and
+   checks that each buffer got the right piece of it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char head[17], middle[100], tail[sizeof sample];
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof head;
+  iov[1].iov_base = middle;
+  iov[1].iov_len = sizeof middle;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof tail;
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("readv() returned %d instead of %zu", byte_cnt, size);
+
+  if (memcmp (head, sample, sizeof head)
+      || memcmp (middle, sample + sizeof head, sizeof middle)
+      || memcmp (tail, sample + sizeof head + sizeof middle,
+                 size - sizeof head - sizeof middle))
+    fail ("readv() returned wrong data");
+
+  if (tell (handle) != size)
+    fail ("readv() left file position at %u instead of %zu",
+          tell (handle), size);
+
+  msg ("close \"sample.txt\"");
+  close (handle);
+}
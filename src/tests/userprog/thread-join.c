@@ -0,0 +1,50 @@
+/* Starts several threads that increment a shared counter under a
+   mutex, then joins them and checks their return values and the
+   final count, and that a thread cannot be joined twice. */
+
+#include <pthread.h>
+#include <synch.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERATIONS 1000
+
+static struct mutex mutex = MUTEX_INITIALIZER;
+static int counter;
+
+static void *
+increment (void *arg) 
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      mutex_lock (&mutex);
+      counter++;
+      mutex_unlock (&mutex);
+    }
+  return arg;
+}
+
+void
+test_main (void) 
+{
+  pthread_t threads[THREAD_CNT];
+  void *retval;
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (pthread_create (&threads[i], increment, (void *) i) == 0,
+           "create thread %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      CHECK (pthread_join (threads[i], &retval) == 0, "join thread %d", i);
+      if ((int) retval != i)
+        fail ("thread %d returned %d", i, (int) retval);
+    }
+  CHECK (pthread_join (threads[0], NULL) == -1, "join thread 0 again");
+  if (counter != THREAD_CNT * ITERATIONS)
+    fail ("counter is %d, expected %d", counter, THREAD_CNT * ITERATIONS);
+}
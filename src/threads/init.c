@@ -10,6 +10,7 @@
 #include <string.h>
 #include "devices/kbd.h"
 #include "devices/input.h"
+#include "devices/pci.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
@@ -22,6 +23,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,6 +36,8 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,8 +56,18 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -iotrace: Number of block requests to keep in the trace ring. */
+static size_t iotrace_size;
+
+/* -ramdisk: Size of the RAM disk in kB, or 0 for none. */
+static size_t ramdisk_size;
 #endif /* FILESYS */
 
+/* -schedtrace: Number of scheduler events to keep in the trace
+   ring. */
+static size_t schedtrace_size;
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
@@ -116,13 +130,20 @@ main (void)
 #endif
 
   /* Start thread scheduler and enable interrupts. */
+  thread_trace_init (schedtrace_size);
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
+  console_start_flusher ();
   timer_calibrate ();
+  pci_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
+  block_trace_init (iotrace_size);
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init (ramdisk_size);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -251,11 +272,17 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+      else if (!strcmp (name, "-iotrace"))
+        iotrace_size = atoi (value);
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-schedtrace"))
+        schedtrace_size = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -376,9 +403,12 @@ usage (void)
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
+          "  -iotrace=COUNT     Trace the last COUNT block requests.\n"
+          "  -ramdisk=KB        Create a KB kB RAM disk named ram0.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -schedtrace=COUNT  Trace the last COUNT scheduler events.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
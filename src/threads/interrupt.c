@@ -8,7 +8,12 @@
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -358,7 +363,14 @@ intr_handler (struct intr_frame *frame)
       ASSERT (!intr_context ());
 
       in_external_intr = true;
-      yield_on_return = false;
+
+      /* Keep a yield already requested by the interrupt whose
+         bottom halves we interrupted. */
+      if (!bh_active ())
+        yield_on_return = false;
+
+      /* The CPU may have been idling without timer ticks. */
+      timer_idle_exit (frame->vec_no == 0x20);
     }
 
   /* Invoke the interrupt's handler. */
@@ -383,8 +395,20 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
+      /* Run what this and earlier handlers deferred. */
+      bh_run ();
+
+      /* If we interrupted bh_run(), the interrupt that started it
+         yields once its bottom halves are done. */
+      if (yield_on_return && !bh_active ()) 
         thread_yield (); 
+
+#ifdef USERPROG
+      /* Catch threads of an exiting process that do not make
+         system calls. */
+      if (frame->cs == SEL_UCSEG)
+        process_check_exit ();
+#endif
     }
 }
 
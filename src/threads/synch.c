@@ -31,6 +31,10 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef LOCK_PROFILE
+#include <inttypes.h>
+#include "devices/timer.h"
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
  nonnegative integer along with two atomic operators for
@@ -45,7 +49,7 @@ void sema_init(struct semaphore *sema, unsigned value) {
     ASSERT(sema != NULL);
 
     sema->value = value;
-    list_init(&sema->waiters);
+    waitq_init(&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -63,7 +67,9 @@ void sema_down(struct semaphore *sema) {
 
     old_level = intr_disable();
     while (sema->value == 0) {
-        list_push_back(&sema->waiters, &thread_current()->elem);
+        struct thread *cur = thread_current();
+        waitq_push(&sema->waiters, &cur->wait_elem, get_priority(cur));
+        cur->waitq = &sema->waiters;
         thread_block();
     }
     sema->value--;
@@ -105,9 +111,9 @@ void sema_up(struct semaphore *sema) {
 
     old_level = intr_disable();
 
-    if (!list_empty(&sema->waiters)) {
-        list_sort(&sema->waiters, priority_compare, 0);
-        t = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
+    if (!waitq_empty(&sema->waiters)) {
+        t = waitq_entry(waitq_pop(&sema->waiters), struct thread, wait_elem);
+        t->waitq = NULL;
         thread_unblock(t);
     }
 
@@ -151,6 +157,157 @@ static void sema_test_helper(void *sema_) {
     }
 }
 
+#ifdef LOCK_PROFILE
+/* Lock contention profiling.
+
+ Statistics are kept per lock class, that is, for all the locks
+ initialized by the same call to lock_init().  So the locks of
+ all the IDE channels are counted together, and locks that come
+ and go, such as those in each thread, need no bookkeeping of
+ their own.  lock_print_stats() identifies classes by the
+ address of that call, and call sites that had to wait for a lock
+ by the address of their call to lock_acquire(), which the
+ backtrace utility translates into function names and line
+ numbers.  Only the LOCK_SITES sites that waited longest are
+ kept for each class: a new site replaces the one that waited
+ least, so a site that waits rarely may drop out and come back
+ with its counts started over. */
+
+#define LOCK_CLASSES 64         /* Maximum number of lock classes. */
+#define LOCK_SITES 4            /* Waiting call sites kept per class. */
+
+/* A call site that had to wait for a lock. */
+struct lock_site {
+    void *pc;                   /* Return address of lock_acquire(). */
+    unsigned contended;         /* Acquisitions that had to wait. */
+    int64_t wait_ns;            /* Total time waited. */
+};
+
+/* Statistics for the locks initialized at one place. */
+struct lock_class {
+    void *init_pc;              /* Return address of lock_init(). */
+    unsigned acquired;          /* Acquisitions. */
+    unsigned contended;         /* Acquisitions that had to wait. */
+    int64_t wait_ns;            /* Total time waited to acquire. */
+    int64_t max_wait_ns;        /* Longest wait to acquire. */
+    int64_t hold_ns;            /* Total time held. */
+    int64_t max_hold_ns;        /* Longest time held. */
+    struct lock_site sites[LOCK_SITES]; /* Sites that waited most. */
+};
+
+/* Lock classes, hashed by INIT_PC with linear probing. */
+static struct lock_class lock_classes[LOCK_CLASSES];
+
+/* Returns the class of locks initialized at INIT_PC, adding it
+ if it is new, or a null pointer if there are too many classes
+ to add it. */
+static struct lock_class *lock_class_lookup(void *init_pc) {
+    enum intr_level old_level = intr_disable();
+    unsigned start = (uintptr_t) init_pc / 4 % LOCK_CLASSES;
+    struct lock_class *class = NULL;
+    unsigned i;
+
+    for (i = 0; i < LOCK_CLASSES; i++) {
+        struct lock_class *c = &lock_classes[(start + i) % LOCK_CLASSES];
+        if (c->init_pc == init_pc || c->init_pc == NULL) {
+            c->init_pc = init_pc;
+            class = c;
+            break;
+        }
+    }
+    intr_set_level(old_level);
+    return class;
+}
+
+/* Records that the running thread acquired LOCK from PC at time
+ NOW, having started to wait at START if CONTENDED. */
+static void lock_profile_acquired(struct lock *lock, void *pc,
+        bool contended, int64_t start, int64_t now) {
+    struct lock_class *class = lock->class;
+    enum intr_level old_level;
+    int64_t wait = now - start;
+    int i;
+
+    lock->acquire_time = now;
+    if (class == NULL)
+        return;
+
+    old_level = intr_disable();
+    class->acquired++;
+    if (contended) {
+        class->contended++;
+        class->wait_ns += wait;
+        if (wait > class->max_wait_ns)
+            class->max_wait_ns = wait;
+        struct lock_site *site = &class->sites[0];
+        for (i = 0; i < LOCK_SITES; i++) {
+            struct lock_site *s = &class->sites[i];
+            if (s->pc == pc) {
+                site = s;
+                break;
+            }
+            if (s->wait_ns < site->wait_ns || s->pc == NULL)
+                site = s;
+        }
+        if (site->pc != pc) {
+            site->pc = pc;
+            site->contended = 0;
+            site->wait_ns = 0;
+        }
+        site->contended++;
+        site->wait_ns += wait;
+    }
+    intr_set_level(old_level);
+}
+
+/* Records that LOCK is being released. */
+static void lock_profile_released(struct lock *lock) {
+    struct lock_class *class = lock->class;
+    int64_t hold = timer_ns() - lock->acquire_time;
+    enum intr_level old_level;
+
+    if (class == NULL)
+        return;
+
+    old_level = intr_disable();
+    class->hold_ns += hold;
+    if (hold > class->max_hold_ns)
+        class->max_hold_ns = hold;
+    intr_set_level(old_level);
+}
+
+/* Prints the statistics of each lock class that was acquired,
+ those that waited longest in total first.  Times are in
+ microseconds. */
+void lock_print_stats(void) {
+    bool printed[LOCK_CLASSES] = { false };
+
+    for (;;) {
+        struct lock_class *c = NULL;
+        int i;
+
+        for (i = 0; i < LOCK_CLASSES; i++)
+            if (!printed[i] && lock_classes[i].acquired > 0
+                    && (c == NULL || lock_classes[i].wait_ns > c->wait_ns))
+                c = &lock_classes[i];
+        if (c == NULL)
+            break;
+        printed[c - lock_classes] = true;
+
+        printf("Lock %p: %u acquired, %u contended, "
+                "wait %"PRId64" us (max %"PRId64"), "
+                "hold %"PRId64" us (max %"PRId64")\n",
+                c->init_pc, c->acquired, c->contended,
+                c->wait_ns / 1000, c->max_wait_ns / 1000,
+                c->hold_ns / 1000, c->max_hold_ns / 1000);
+        for (i = 0; i < LOCK_SITES && c->sites[i].pc != NULL; i++)
+            printf("  waited at %p: %u times, %"PRId64" us\n",
+                    c->sites[i].pc, c->sites[i].contended,
+                    c->sites[i].wait_ns / 1000);
+    }
+}
+#endif /* LOCK_PROFILE */
+
 /* Initializes LOCK.  A lock can be held by at most a single
  thread at any given time.  Our locks are not "recursive", that
  is, it is an error for the thread currently holding a lock to
@@ -172,6 +329,9 @@ void lock_init(struct lock *lock) {
     lock->priority = 0;
     lock->holder = NULL;
     sema_init(&lock->semaphore, 1);
+#ifdef LOCK_PROFILE
+    lock->class = lock_class_lookup(__builtin_return_address(0));
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -190,6 +350,10 @@ void lock_acquire(struct lock *lock) {
     struct thread *holder = lock->holder;
     struct thread *cur = thread_current();
     struct lock *next_lock = lock;
+#ifdef LOCK_PROFILE
+    bool contended = lock->semaphore.value == 0;
+    int64_t start = contended ? timer_ns() : 0;
+#endif
 
     cur->waiting_for_lock = lock;
 
@@ -197,8 +361,13 @@ void lock_acquire(struct lock *lock) {
         lock->priority = get_priority(cur);
     }
 
+    /* Donating changes the holders' places in the ready queues,
+     so keep the scheduler out until they are requeued. */
+    enum intr_level old_level = intr_disable();
     while (holder != NULL && get_priority(holder) < get_priority(cur)) {
         holder->donated_priority = get_priority(cur);
+        thread_requeue(holder);
+        thread_trace_priority(holder, cur);
         /*for nested donation*/
         while (next_lock != NULL) {
             if (get_priority(cur) > next_lock->priority) {
@@ -206,13 +375,20 @@ void lock_acquire(struct lock *lock) {
             }
             if (get_priority(cur) > get_priority(next_lock->holder)) {
                 next_lock->holder->donated_priority = get_priority(cur);
+                thread_requeue(next_lock->holder);
+                thread_trace_priority(next_lock->holder, cur);
             }
             next_lock = next_lock->holder->waiting_for_lock;
         }
     }
+    intr_set_level(old_level);
 
     sema_down(&lock->semaphore);
     lock->holder = thread_current();
+#ifdef LOCK_PROFILE
+    lock_profile_acquired(lock, __builtin_return_address(0), contended,
+            start, timer_ns());
+#endif
 
     cur->waiting_for_lock = NULL;
     list_push_back(&(lock->holder->donation_locks), &lock->lock_elem);
@@ -232,8 +408,13 @@ bool lock_try_acquire(struct lock *lock) {
     ASSERT(!lock_held_by_current_thread(lock));
 
     success = sema_try_down(&lock->semaphore);
-    if (success)
+    if (success) {
         lock->holder = thread_current();
+#ifdef LOCK_PROFILE
+        lock_profile_acquired(lock, __builtin_return_address(0), false, 0,
+                timer_ns());
+#endif
+    }
     return success;
 }
 
@@ -250,6 +431,7 @@ void lock_release(struct lock *lock) {
     struct thread *holder = lock->holder;
     struct lock *next_lock = NULL;
     struct thread *next_thread = NULL;
+    int old_priority = get_priority(cur);
 
     list_remove(&lock->lock_elem);
     if (!list_empty(&cur->donation_locks)) {
@@ -262,7 +444,12 @@ void lock_release(struct lock *lock) {
     } else {
         cur->donated_priority = 0;
     }
+    if (get_priority(cur) != old_priority)
+        thread_trace_priority(cur, NULL);
 
+#ifdef LOCK_PROFILE
+    lock_profile_released(lock);
+#endif
     lock->priority = 0;
     lock->holder = NULL;
     sema_up(&lock->semaphore);
@@ -278,34 +465,20 @@ bool lock_held_by_current_thread(const struct lock *lock) {
     return lock->holder == thread_current();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a wait queue.  Queued at the priority its
+ thread had when it began waiting. */
 struct semaphore_elem {
-    struct list_elem elem; /* List element. */
+    struct waitq_elem elem; /* Wait queue element. */
     struct semaphore semaphore; /* This semaphore. */
 };
 
-/* Compare the priority of threads in semaphores */
-bool semaphore_compare(const struct list_elem *a, const struct list_elem *b,
-        void *aux) {
-    struct semaphore *sema_a =
-            &list_entry (a, struct semaphore_elem, elem)->semaphore;
-    struct semaphore *sema_b =
-            &list_entry (b, struct semaphore_elem, elem)->semaphore;
-
-    int priority_a =
-            list_entry (list_max (&sema_a->waiters, priority_compare, 0), struct thread, elem)->priority;
-    int priority_b =
-            list_entry (list_max (&sema_b->waiters, priority_compare, 0), struct thread, elem)->priority;
-    return (priority_a > priority_b);
-}
-
 /* Initializes condition variable COND.  A condition variable
  allows one piece of code to signal a condition and cooperating
  code to receive the signal and act upon it. */
 void cond_init(struct condition *cond) {
     ASSERT(cond != NULL);
 
-    list_init(&cond->waiters);
+    waitq_init(&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -337,7 +510,7 @@ void cond_wait(struct condition *cond, struct lock *lock) {
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
-    list_push_back(&cond->waiters, &waiter.elem);
+    waitq_push(&cond->waiters, &waiter.elem, get_priority(thread_current()));
     lock_release(lock);
     sema_down(&waiter.semaphore);
     lock_acquire(lock);
@@ -356,9 +529,8 @@ void cond_signal(struct condition *cond, struct lock *lock UNUSED) {
     ASSERT(!intr_context());
     ASSERT(lock_held_by_current_thread(lock));
 
-    if (!list_empty(&cond->waiters)) {
-        list_sort(&cond->waiters, semaphore_compare, 0);
-        sema_up(&list_entry (list_pop_front (&cond->waiters),
+    if (!waitq_empty(&cond->waiters)) {
+        sema_up(&waitq_entry (waitq_pop (&cond->waiters),
                 struct semaphore_elem, elem)->semaphore);
     }
 }
@@ -373,6 +545,277 @@ void cond_broadcast(struct condition *cond, struct lock *lock) {
     ASSERT(cond != NULL);
     ASSERT(lock != NULL);
 
-    while (!list_empty(&cond->waiters))
+    while (!waitq_empty(&cond->waiters))
         cond_signal(cond, lock);
 }
+
+/* Initializes RW as a readers-writer lock.  Any number of threads
+ may hold it for reading at once, or a single thread for
+ writing.
+
+ A writer holds RW's `gate' lock for as long as it writes, and
+ readers pass through the gate to begin reading.  Thus, as soon as
+ a writer arrives, it shuts out readers that arrive after it and
+ only waits for the readers already inside to leave: writers are
+ preferred.  Threads waiting at the gate donate their priority to
+ the writer, as for any lock; readers do not receive donations.
+
+ Readers that find the gate open and nobody waiting at it do not
+ touch the gate at all, so readers do not serialize each other. */
+void rwlock_init(struct rwlock *rw) {
+    ASSERT(rw != NULL);
+
+    lock_init(&rw->gate);
+    rw->readers = 0;
+    rw->draining = false;
+    sema_init(&rw->drained, 0);
+    rw->writes = 0;
+}
+
+/* Acquires RW for reading, sleeping while it is held or awaited
+ for writing.  The current thread must not hold RW for writing.
+
+ This function may sleep, so it must not be called within an
+ interrupt handler. */
+void rwlock_acquire_read(struct rwlock *rw) {
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!rwlock_held_for_write(rw));
+
+    old_level = intr_disable();
+    if (rw->gate.holder == NULL
+            && waitq_empty(&rw->gate.semaphore.waiters)) {
+        rw->readers++;
+        intr_set_level(old_level);
+        return;
+    }
+    intr_set_level(old_level);
+
+    lock_acquire(&rw->gate);
+    old_level = intr_disable();
+    rw->readers++;
+    intr_set_level(old_level);
+    lock_release(&rw->gate);
+}
+
+/* Releases RW, which the current thread must hold for reading.
+ The last reader to leave lets a waiting writer in. */
+void rwlock_release_read(struct rwlock *rw) {
+    enum intr_level old_level;
+    bool wake;
+
+    ASSERT(rw != NULL);
+
+    old_level = intr_disable();
+    ASSERT(rw->readers > 0);
+    wake = --rw->readers == 0 && rw->draining;
+    if (wake)
+        rw->draining = false;
+    intr_set_level(old_level);
+
+    if (wake)
+        sema_up(&rw->drained);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+ it.  The current thread must not already hold RW.
+
+ This function may sleep, so it must not be called within an
+ interrupt handler. */
+void rwlock_acquire_write(struct rwlock *rw) {
+    enum intr_level old_level;
+
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+
+    lock_acquire(&rw->gate);
+
+    /* Wait for the readers already inside to leave. */
+    old_level = intr_disable();
+    if (rw->readers > 0) {
+        rw->draining = true;
+        intr_set_level(old_level);
+        sema_down(&rw->drained);
+    } else
+        intr_set_level(old_level);
+
+    rw->writes++;
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void rwlock_release_write(struct rwlock *rw) {
+    ASSERT(rwlock_held_for_write(rw));
+
+    lock_release(&rw->gate);
+}
+
+/* Converts the current thread's hold on RW from reading to
+ writing.  Another thread may acquire RW for writing before the
+ conversion completes; otherwise two threads upgrading at once
+ would wait for each other forever.  Returns true if that did not
+ happen, so that whatever the current thread read is still valid,
+ false if it did. */
+bool rwlock_upgrade(struct rwlock *rw) {
+    unsigned writes = rw->writes;
+
+    rwlock_release_read(rw);
+    rwlock_acquire_write(rw);
+    return rw->writes == writes + 1;
+}
+
+/* Converts the current thread's hold on RW from writing to
+ reading, letting in the readers waiting at the gate.  No writer
+ can get in between. */
+void rwlock_downgrade(struct rwlock *rw) {
+    enum intr_level old_level;
+
+    ASSERT(rwlock_held_for_write(rw));
+
+    old_level = intr_disable();
+    rw->readers++;
+    intr_set_level(old_level);
+    lock_release(&rw->gate);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+ otherwise. */
+bool rwlock_held_for_write(const struct rwlock *rw) {
+    ASSERT(rw != NULL);
+
+    return lock_held_by_current_thread(&rw->gate);
+}
+
+/* Returns true if wait queue element A should be woken before
+ B: it has higher priority, or the same priority and arrived
+ earlier. */
+static bool waitq_before(const struct waitq_elem *a,
+        const struct waitq_elem *b) {
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return (int) (a->seq - b->seq) < 0;
+}
+
+/* Melds the heaps rooted at A and B, either of which may be
+ null, and returns the root of the result. */
+static struct waitq_elem *waitq_meld(struct waitq_elem *a,
+        struct waitq_elem *b) {
+    struct waitq_elem *tmp;
+
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (waitq_before(b, a)) {
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* Make B the leftmost child of A. */
+    b->prev = a;
+    b->sibling = a->child;
+    if (a->child != NULL)
+        a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+/* Melds FIRST and the siblings to its right into a single heap,
+ and returns its root.  Melds them in pairs from left to right,
+ then melds the pairs from right to left, which is what keeps the
+ pairing heap's amortized cost logarithmic. */
+static struct waitq_elem *waitq_merge_pairs(struct waitq_elem *first) {
+    struct waitq_elem *pairs = NULL;
+    struct waitq_elem *root = NULL;
+
+    while (first != NULL) {
+        struct waitq_elem *a = first;
+        struct waitq_elem *b = a->sibling;
+
+        first = b != NULL ? b->sibling : NULL;
+        a->sibling = a->prev = NULL;
+        if (b != NULL)
+            b->sibling = b->prev = NULL;
+
+        /* Stack up the pairs, linked through `sibling'. */
+        a = waitq_meld(a, b);
+        a->sibling = pairs;
+        pairs = a;
+    }
+
+    while (pairs != NULL) {
+        struct waitq_elem *next = pairs->sibling;
+        pairs->sibling = NULL;
+        root = waitq_meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+/* Initializes Q as an empty wait queue. */
+void waitq_init(struct waitq *q) {
+    ASSERT(q != NULL);
+
+    q->first = NULL;
+    q->next_seq = 0;
+}
+
+/* Returns true if Q has no waiters. */
+bool waitq_empty(const struct waitq *q) {
+    return q->first == NULL;
+}
+
+/* Adds E to Q, behind the waiters already in Q with PRIORITY or
+ higher. */
+void waitq_push(struct waitq *q, struct waitq_elem *e, int priority) {
+    e->child = e->sibling = e->prev = NULL;
+    e->priority = priority;
+    e->seq = q->next_seq++;
+    q->first = waitq_meld(q->first, e);
+}
+
+/* Removes and returns the first waiter in Q, which must not be
+ empty. */
+struct waitq_elem *
+waitq_pop(struct waitq *q) {
+    struct waitq_elem *e = q->first;
+
+    ASSERT(e != NULL);
+    waitq_remove(q, e);
+    return e;
+}
+
+/* Removes E, which must be in Q. */
+void waitq_remove(struct waitq *q, struct waitq_elem *e) {
+    struct waitq_elem *rest;
+
+    if (e == q->first) {
+        q->first = waitq_merge_pairs(e->child);
+    } else {
+        /* Unlink E from its parent or left sibling, then put its
+         children back into the heap. */
+        if (e->prev->child == e)
+            e->prev->child = e->sibling;
+        else
+            e->prev->sibling = e->sibling;
+        if (e->sibling != NULL)
+            e->sibling->prev = e->prev;
+        rest = waitq_merge_pairs(e->child);
+        q->first = waitq_meld(q->first, rest);
+    }
+    e->child = e->sibling = e->prev = NULL;
+}
+
+/* Changes the priority of E, which must be in Q, to PRIORITY.
+ E keeps its place among waiters of its new priority that
+ arrived after it did. */
+void waitq_update(struct waitq *q, struct waitq_elem *e, int priority) {
+    if (e->priority == priority)
+        return;
+
+    waitq_remove(q, e);
+    e->priority = priority;
+    q->first = waitq_meld(q->first, e);
+}
@@ -3,12 +3,50 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wait queue.
+
+   Holds waiters in order of priority, highest first, and in
+   order of arrival among waiters of equal priority.  It is a
+   pairing heap, so adding a waiter takes constant time and
+   removing the first one, or changing a waiter's priority, takes
+   O(log n) amortized time. */
+struct waitq_elem 
+  {
+    struct waitq_elem *child;   /* Leftmost child. */
+    struct waitq_elem *sibling; /* Next sibling to the right. */
+    struct waitq_elem *prev;    /* Left sibling, or parent if leftmost. */
+    int priority;               /* Priority of the waiter. */
+    unsigned seq;               /* Arrival order. */
+  };
+
+struct waitq 
+  {
+    struct waitq_elem *first;   /* Highest priority waiter, or NULL. */
+    unsigned next_seq;          /* Arrival number for the next waiter. */
+  };
+
+/* Converts pointer to wait queue element WAITQ_ELEM into a
+   pointer to the structure that it is embedded inside, like
+   list_entry(). */
+#define waitq_entry(WAITQ_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) (WAITQ_ELEM)                   \
+                     - offsetof (STRUCT, MEMBER)))
+
+void waitq_init (struct waitq *);
+bool waitq_empty (const struct waitq *);
+void waitq_push (struct waitq *, struct waitq_elem *, int priority);
+struct waitq_elem *waitq_pop (struct waitq *);
+void waitq_remove (struct waitq *, struct waitq_elem *);
+void waitq_update (struct waitq *, struct waitq_elem *, int priority);
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;                  /* Current value. */
-    struct list waiters;             /* List of waiting threads. */
+    struct waitq waiters;            /* Waiting threads. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -24,6 +62,10 @@ struct lock
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     struct list_elem lock_elem; /* List elem for donation_locks in thread.h. */
     int priority;               /* The priority of the lock. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Statistics, or a null pointer. */
+    int64_t acquire_time;       /* timer_ns() when last acquired. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -32,10 +74,18 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock contention profiling.  Build with LOCK_PROFILE defined,
+   e.g. by adding -DLOCK_PROFILE to DEFINES in a project's
+   Make.vars, to keep statistics on lock waits and hold times and
+   print them at shutdown. */
+#ifdef LOCK_PROFILE
+void lock_print_stats (void);
+#endif
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting semaphore_elems. */
+    struct waitq waiters;       /* Waiting semaphore_elems. */
   };
 
 void cond_init (struct condition *);
@@ -43,6 +93,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock 
+  {
+    struct lock gate;           /* Held by the writer. */
+    unsigned readers;           /* Number of threads reading. */
+    bool draining;              /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+    unsigned writes;            /* Number of times acquired for writing. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
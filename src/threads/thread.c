@@ -1,5 +1,6 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
@@ -7,10 +8,12 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 #include "threads/fixed-point.h"
 #include "devices/timer.h"
@@ -28,17 +31,21 @@
  of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
- that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+ ready to run but not actually running, in a FIFO queue for each
+ priority.  Bit P of ready_mask is set if and only if
+ ready_queues[P] is nonempty, so that the highest priority ready
+ thread can be found with a single bit scan.  ready_cnt is the
+ total number of ready threads. */
+#define READY_WORDS ((PRI_MAX + 32) / 32)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_mask[READY_WORDS];
+static size_t ready_cnt;
 
 /* List of all processes.  Processes are added to this list
  when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/*List of all sleeping threads*/
-static struct list sleep_thread_list;
-
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -72,6 +79,73 @@ bool thread_mlfqs;
 /*System load average in 17.14 Fixed Point format*/
 static int32_t load_avg = 0;
 
+/* Once a second, the 4.4BSD scheduler multiplies every thread's
+ recent_cpu by a decay coefficient that depends on load_avg and
+ adds its nice value.  Only the running and ready threads are
+ decayed right away.  A blocked thread catches up when it is
+ unblocked, using the coefficients of the seconds it missed, kept
+ in decay_history.  The coefficient is 2*load_avg/(2*load_avg+1),
+ so even at a load_avg of 60 the product of DECAY_HISTORY of them
+ is below 0.0003.  A thread blocked for longer than that has
+ forgotten its old recent_cpu: it is left with the sum of its
+ nice values, as decayed over the seconds in the history.
+ decay_seconds counts the decays so far. */
+#define DECAY_HISTORY 1024
+static int32_t decay_history[DECAY_HISTORY];
+static unsigned decay_seconds;
+
+/* Recomputes load_avg and decays recent_cpu once per second. */
+static struct bh decay_bh;
+
+/* Kinds of scheduler events. */
+enum sched_event_type {
+    SCHED_SWITCH,                   /* TID switched out for OTHER. */
+    SCHED_WAKEUP,                   /* TID made ready by OTHER. */
+    SCHED_BLOCK,                    /* TID blocked. */
+    SCHED_PRIORITY,                 /* TID's priority changed. */
+    SCHED_DONATE                    /* OTHER donated priority to TID. */
+};
+
+/* Reasons for a SCHED_SWITCH, in the order of their names below. */
+enum sched_switch_reason {
+    SWITCH_YIELD,                   /* Yielded, still ready. */
+    SWITCH_SLICE,                   /* Time slice ran out. */
+    SWITCH_PREEMPT,                 /* Higher-priority thread ready. */
+    SWITCH_BLOCK,                   /* Blocked. */
+    SWITCH_EXIT                     /* Exited. */
+};
+static const char *sched_event_names[] = { "switch", "wakeup", "block",
+        "priority", "donate" };
+static const char *switch_reason_names[] = { "yield", "slice", "preempt",
+        "block", "exit" };
+
+/* Why the running thread is giving up the CPU while still ready,
+ if it was not a plain thread_yield().  Set with interrupts off
+ just before the yield and reset by schedule(). */
+static enum sched_switch_reason yield_reason = SWITCH_YIELD;
+
+/* A scheduler event, as recorded in the trace ring.  OTHER is 0
+ if there is no other thread involved, as for a thread woken up
+ by an interrupt handler. */
+struct sched_event {
+    uint64_t time;                  /* timer_cycles() at the event. */
+    tid_t tid;                      /* Thread the event is about. */
+    tid_t other;                    /* Other thread involved, or 0. */
+    uint8_t type;                   /* A sched_event_type. */
+    uint8_t reason;                 /* A sched_switch_reason. */
+    uint8_t priority;               /* TID's effective priority. */
+    uint8_t other_priority;         /* OTHER's effective priority. */
+};
+
+/* Trace ring holding the last trace_size scheduler events, or a
+ null pointer if tracing is disabled.  trace_next is the slot to
+ fill next and trace_cnt the number of events ever recorded.
+ Protected by disabling interrupts. */
+static struct sched_event *trace;
+static size_t trace_size;
+static size_t trace_next;
+static unsigned long long trace_cnt;
+
 static void kernel_thread(thread_func *, void *aux);
 
 static void idle(void *aux UNUSED);
@@ -81,6 +155,12 @@ static void init_thread(struct thread *, const char *name, int priority);
 static bool is_thread(struct thread *) UNUSED;
 static void *alloc_frame(struct thread *, size_t size);
 static void schedule(void);
+static void ready_push(struct thread *);
+static void ready_remove(struct thread *);
+static int ready_max_priority(void);
+static void decay_ready_threads(void *aux);
+static void trace_event(enum sched_event_type, struct thread *,
+        struct thread *other, enum sched_switch_reason);
 void thread_schedule_tail(struct thread *prev);
 static tid_t allocate_tid(void);
 
@@ -98,13 +178,16 @@ static tid_t allocate_tid(void);
  It is not safe to call thread_current() until this function
  finishes. */
 void thread_init(void) {
+    int i;
+
     ASSERT(intr_get_level() == INTR_OFF);
 
     lock_init(&tid_lock);
-    list_init(&ready_list);
+    for (i = 0; i <= PRI_MAX; i++)
+        list_init(&ready_queues[i]);
     list_init(&all_list);
-    list_init(&sleep_thread_list);
     lock_init(&page_lock);
+    bh_init(&decay_bh, decay_ready_threads, NULL);
 
     frame_init();
     /* Set up a thread structure for the running thread. */
@@ -150,17 +233,19 @@ void thread_tick(void) {
     }
 
     /* Enforce preemption. */
-    if (++thread_ticks >= TIME_SLICE)
+    if (++thread_ticks >= TIME_SLICE) {
+        yield_reason = SWITCH_SLICE;
         intr_yield_on_return();
+    }
 }
 
 void update_BSD_variables(void) {
     struct thread *current_thread = thread_current();
 
-    /*load_avg and recent_cpu of all threads are recalculated every second*/
+    /*load_avg and recent_cpu of running and ready threads are
+     recalculated every second, once this interrupt returns*/
     if (timer_ticks() % TIMER_FREQ == 0) {
-        thread_calc_load_avg();
-        thread_foreach(&thread_calc_recent_cpu, NULL);
+        bh_schedule(&decay_bh);
     }
 
     /*
@@ -173,52 +258,57 @@ void update_BSD_variables(void) {
     }
 
     /*
-     Recalculated priority of all the threads each tick.
+     Recalculate the running thread's priority each time slice.
+     Nothing else changes the priority of the other threads
+     between decays.
      */
     if (timer_ticks() % TIME_SLICE == 0) {
-        thread_foreach(&thread_calc_priority, NULL);
+        thread_calc_priority(current_thread, NULL);
     }
 
 }
 
-/*push the sleep_elem of a sleeping thread into the
- sleep_thread_list in ascending order accoding to their sleep_time*/
-void push_to_sleep_thread_list(struct list_elem *e) {
-    list_insert_ordered(&sleep_thread_list, e, thread_compare, 0);
-}
+/* Updates load_avg and records this second's recent_cpu decay
+ coefficient, then applies it to the running thread and to each
+ ready thread, moving them to the ready queues for their new
+ priorities.  Blocked threads are left to catch up in
+ thread_unblock().
 
-/*Iterate through the list of sleeping thread. If the sleep_time in 
- current thread is less than current timer ticks, turn the semaphore
- in the current thread up and remove the thread from the sleeping
- thread list.*/
-void wake_threads(void) {
-    int64_t current_time = timer_ticks();
+ Runs as a bottom half of the timer interrupt, so that
+ interrupts are off for only one ready queue at a time. */
+static void decay_ready_threads(void *aux UNUSED) {
+    enum intr_level old_level = intr_disable();
+    int32_t coefficient;
+    int priority;
 
-    if (!list_empty(&sleep_thread_list)) {
+    thread_calc_load_avg();
+    coefficient = FIXED_POINT_MUL_INT(load_avg, 2);
+    coefficient = FIXED_POINT_DIV_FIXED_POINT(coefficient,
+            FIXED_POINT_ADD_INT(coefficient, 1));
+    decay_history[decay_seconds % DECAY_HISTORY] = coefficient;
+    decay_seconds++;
 
-        struct list_elem *e = list_begin(&sleep_thread_list);
-        struct thread *thread_current = list_entry(e, struct thread,
-                sleep_elem);
+    if (thread_current() != idle_thread)
+        thread_calc_recent_cpu(thread_current(), NULL);
+    intr_set_level(old_level);
 
-        while (thread_current->sleep_time <= current_time
-                && e != list_end(&sleep_thread_list)) {
-            sema_up(thread_current->semaphore);
-            list_remove(e);
-            e = list_next(e);
-            thread_current = list_entry(e, struct thread, sleep_elem);
+    /* A thread may move to a queue not yet visited, but it is
+     then already up to date, so visiting it again is harmless. */
+    for (priority = PRI_MAX; priority >= PRI_MIN; priority--) {
+        struct list *queue = &ready_queues[priority];
+        struct list_elem *e, *next;
+
+        old_level = intr_disable();
+        for (e = list_begin(queue); e != list_end(queue); e = next) {
+            struct thread *t = list_entry(e, struct thread, elem);
+            next = list_next(e);
+            thread_calc_recent_cpu(t, NULL);
+            thread_calc_priority(t, NULL);
         }
+        intr_set_level(old_level);
     }
 }
 
-/*compare two thread according to their sleep_time,
- return true if the sleep_time of the first thread is less than the second*/
-bool thread_compare(const struct list_elem *a, const struct list_elem *b,
-        void *aux) {
-    struct thread *thread_a = list_entry(a, struct thread, sleep_elem);
-    struct thread *thread_b = list_entry(b, struct thread, sleep_elem);
-    return (thread_a->sleep_time <= thread_b->sleep_time);
-}
-
 /*Compare two threads according to their effective priority,
  * return true if the priority of the first thread is higher than the second*/
 bool priority_compare(const struct list_elem *a, const struct list_elem *b,
@@ -232,6 +322,75 @@ bool priority_compare(const struct list_elem *a, const struct list_elem *b,
 void thread_print_stats(void) {
     printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
             idle_ticks, kernel_ticks, user_ticks);
+    thread_print_trace();
+}
+
+/* Enables the scheduler trace, making it remember the last SIZE
+ scheduler events.  Does nothing if SIZE is 0. */
+void thread_trace_init(size_t size) {
+    if (size == 0)
+        return;
+
+    trace = calloc(size, sizeof *trace);
+    if (trace == NULL) {
+        printf("thread: not enough memory for %zu-entry trace\n", size);
+        return;
+    }
+    trace_size = size;
+}
+
+/* Records in the scheduler trace that T's effective priority
+ changed, because DONOR donated its priority to T or, if DONOR
+ is a null pointer, for some other reason. */
+void thread_trace_priority(struct thread *t, struct thread *donor) {
+    trace_event(donor != NULL ? SCHED_DONATE : SCHED_PRIORITY, t, donor,
+            SWITCH_YIELD);
+}
+
+/* Prints the events in the scheduler trace, oldest first, one
+ per line: time-stamp counter, event, thread and its effective
+ priority, other thread and its effective priority, and, for a
+ switch, why the thread was switched out.  Then prints the names
+ of the threads still alive, so that utils/sched-trace can label
+ its timelines.  Does nothing if tracing is disabled. */
+void thread_print_trace(void) {
+    enum intr_level old_level;
+    unsigned long long cnt;
+    size_t i, n, first;
+    struct list_elem *e;
+
+    if (trace == NULL)
+        return;
+
+    old_level = intr_disable();
+    cnt = trace_cnt;
+    n = cnt < trace_size ? cnt : trace_size;
+    first = (trace_next + trace_size - n) % trace_size;
+    intr_set_level(old_level);
+
+    printf("Scheduler trace: %llu events, last %zu follow, "
+            "%"PRIu64" cycles/s\n", cnt, n, timer_cycle_rate());
+    for (i = 0; i < n; i++) {
+        struct sched_event ev;
+
+        old_level = intr_disable();
+        ev = trace[(first + i) % trace_size];
+        intr_set_level(old_level);
+
+        printf("%"PRIu64" %s %d %d %d %d", ev.time,
+                sched_event_names[ev.type], ev.tid, ev.priority, ev.other,
+                ev.other_priority);
+        if (ev.type == SCHED_SWITCH)
+            printf(" %s", switch_reason_names[ev.reason]);
+        printf("\n");
+    }
+
+    printf("Scheduler threads: %zu\n", list_size(&all_list));
+    for (e = list_begin(&all_list); e != list_end(&all_list);
+            e = list_next(e)) {
+        struct thread *t = list_entry(e, struct thread, allelem);
+        printf("%d %s\n", t->tid, t->name);
+    }
 }
 
 bool mfile_compare(const struct list_elem *first_,
@@ -352,6 +511,7 @@ void thread_block(void) {
     ASSERT(!intr_context());
     ASSERT(intr_get_level() == INTR_OFF);
 
+    trace_event(SCHED_BLOCK, thread_current(), NULL, SWITCH_BLOCK);
     thread_current()->status = THREAD_BLOCKED;
     schedule();
 }
@@ -373,9 +533,16 @@ void thread_unblock(struct thread *t) {
     old_level = intr_disable();
     ASSERT(t->status == THREAD_BLOCKED);
 
-    list_insert_ordered(&ready_list, &t->elem, priority_compare, 0);
+    /* Catch up on the decays missed while blocked. */
+    if (thread_mlfqs) {
+        thread_calc_recent_cpu(t, NULL);
+        thread_calc_priority(t, NULL);
+    }
 
+    ready_push(t);
     t->status = THREAD_READY;
+    trace_event(SCHED_WAKEUP, t, intr_context() ? NULL : running_thread(),
+            SWITCH_YIELD);
     intr_set_level(old_level);
 
 }
@@ -440,7 +607,7 @@ void thread_yield(void) {
     old_level = intr_disable();
 
     if (cur != idle_thread) {
-        list_insert_ordered(&ready_list, &cur->elem, priority_compare, 0);
+        ready_push(cur);
     }
     cur->status = THREAD_READY;
     schedule();
@@ -462,31 +629,45 @@ void thread_foreach(thread_action_func *func, void *aux) {
 }
 
 /*This method calls thread_yield in a safer way and it is mainly
- used in priority scheduling.
+ used in priority scheduling, so the switch is traced as a
+ preemption.
  */
 void thread_yield_safe(void) {
     if (!intr_context()) {
+        enum intr_level old_level = intr_disable();
+        yield_reason = SWITCH_PREEMPT;
         thread_yield();
+        intr_set_level(old_level);
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
-void thread_set_priority(int new_priority) {
+/* Moves thread T to the place for its current effective priority
+ in the ready queues, or in the semaphore wait queue it is
+ blocked on, after that priority changed.  Must be called with
+ interrupts off. */
+void thread_requeue(struct thread *t) {
+    ASSERT(is_thread(t));
+    ASSERT(intr_get_level() == INTR_OFF);
 
-    struct thread *next_thread;
-    thread_current()->priority = new_priority;
+    if (t->status == THREAD_READY && t != idle_thread
+            && t->ready_priority != get_priority(t)) {
+        ready_remove(t);
+        ready_push(t);
+    } else if (t->status == THREAD_BLOCKED && t->waitq != NULL)
+        waitq_update(t->waitq, &t->wait_elem, get_priority(t));
+}
 
+/* Sets the current thread's priority to NEW_PRIORITY. */
+void thread_set_priority(int new_priority) {
     enum intr_level old_level = intr_disable();
+    int max_priority;
 
-    if (!list_empty(&ready_list)) {
-        next_thread = list_entry(list_front(&ready_list), struct thread, elem);
-    } else {
-        return;
-    }
-
+    thread_current()->priority = new_priority;
+    thread_trace_priority(thread_current(), NULL);
+    max_priority = ready_max_priority();
     intr_set_level(old_level);
 
-    if (new_priority < get_priority(next_thread))
+    if (get_priority(thread_current()) < max_priority)
         thread_yield_safe();
 }
 
@@ -527,7 +708,7 @@ void thread_calc_priority(struct thread *thread, void *aux) {
     }
 
     thread->priority = result;
-
+    thread_requeue(thread);
 }
 
 /* Sets the current thread's nice value to NICE. */
@@ -535,14 +716,13 @@ void thread_set_nice(int nice UNUSED) {
     ASSERT(thread_mlfqs);
     struct thread* current_thread = thread_current();
     current_thread->nice = nice;
+    enum intr_level old_level = intr_disable();
     thread_calc_priority(current_thread, NULL);
-    int priority = current_thread->priority;
-    if (!list_empty(&ready_list)) {
-        struct thread *next_thread = list_entry(list_front(&ready_list),
-                struct thread, elem);
-        if (priority < next_thread->priority) {
-            thread_yield_safe();
-        }
+    int max_priority = ready_max_priority();
+    intr_set_level(old_level);
+
+    if (current_thread->priority < max_priority) {
+        thread_yield_safe();
     }
 }
 
@@ -570,7 +750,7 @@ void thread_calc_load_avg(void) {
     load_avg = FIXED_POINT_MUL_FIXED_POINT(coefficient, load_avg);
     coefficient = FIXED_POINT_DIV_INT(CONVERT_INT_TO_FIXED_POINT(1), SIXTY);
 
-    int num_of_ready_threads = list_size(&ready_list);
+    int num_of_ready_threads = ready_cnt;
 
     if (thread_current() != idle_thread) {
         num_of_ready_threads++;
@@ -587,22 +767,26 @@ int thread_get_recent_cpu(void) {
     return FIXED_POINT_TO_INT_ROUND_TO_NEAREST(fp_recent_cpu);
 }
 
-/*Recalculate recent_cpu.*/
-void thread_calc_recent_cpu(struct thread *thread, void *aux) {
+/*Recalculate recent_cpu, applying the decays that it has not had
+ yet.*/
+void thread_calc_recent_cpu(struct thread *thread, void *aux UNUSED) {
 
     int32_t recent_cpu = thread->recent_cpu;
+    unsigned second = thread->decay_seconds;
 
-    int32_t current_load_avg = load_avg;
-
-    int32_t coefficient = FIXED_POINT_MUL_INT(current_load_avg, 2);
-
-    coefficient = FIXED_POINT_DIV_FIXED_POINT(coefficient,
-            FIXED_POINT_ADD_INT(coefficient, 1));
+    if (decay_seconds - second > DECAY_HISTORY) {
+        recent_cpu = 0;
+        second = decay_seconds - DECAY_HISTORY;
+    }
 
-    recent_cpu = FIXED_POINT_MUL_FIXED_POINT(coefficient, recent_cpu);
-    recent_cpu = FIXED_POINT_ADD_INT(recent_cpu, thread->nice);
+    for (; second != decay_seconds; second++) {
+        int32_t coefficient = decay_history[second % DECAY_HISTORY];
+        recent_cpu = FIXED_POINT_MUL_FIXED_POINT(coefficient, recent_cpu);
+        recent_cpu = FIXED_POINT_ADD_INT(recent_cpu, thread->nice);
+    }
 
     thread->recent_cpu = recent_cpu;
+    thread->decay_seconds = decay_seconds;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -635,7 +819,12 @@ static void idle(void *idle_started_ UNUSED) {
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         Before halting, stop the periodic timer interrupt if no
+         timer work is due soon, so that the CPU can stay halted
+         until there is some. */
+        timer_idle_enter();
         asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -683,6 +872,7 @@ static void init_thread(struct thread *t, const char *name, int priority) {
     t->priority = priority;
     t->magic = THREAD_MAGIC;
     t->donated_priority = 0;
+    t->decay_seconds = decay_seconds;
     list_init(&t->donation_locks);
     list_init(&t->child_list);
 
@@ -695,6 +885,11 @@ static void init_thread(struct thread *t, const char *name, int priority) {
     list_init(&t->vm_mfiles);
     vm_init_mfile();
 
+    t->process = t;
+    list_init(&t->user_threads);
+    lock_init(&t->process_lock);
+    cond_init(&t->thread_exited);
+
     if (thread_mlfqs) {
         thread_calc_priority(t, NULL);
     }
@@ -723,10 +918,53 @@ alloc_frame(struct thread *t, size_t size) {
  idle_thread. */
 static struct thread *
 next_thread_to_run(void) {
-    if (list_empty(&ready_list))
+    struct thread *t;
+
+    if (ready_cnt == 0)
         return idle_thread;
-    else
-        return list_entry(list_pop_front(&ready_list), struct thread, elem);
+
+    t = list_entry(list_front(&ready_queues[ready_max_priority()]),
+            struct thread, elem);
+    ready_remove(t);
+    return t;
+}
+
+/* Adds T to the back of the ready queue for its effective
+ priority.  Interrupts must be off. */
+static void ready_push(struct thread *t) {
+    int priority = get_priority(t);
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    t->ready_priority = priority;
+    list_push_back(&ready_queues[priority], &t->elem);
+    ready_mask[priority / 32] |= 1u << (priority % 32);
+    ready_cnt++;
+}
+
+/* Removes T from its ready queue.  Interrupts must be off. */
+static void ready_remove(struct thread *t) {
+    int priority = t->ready_priority;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    list_remove(&t->elem);
+    if (list_empty(&ready_queues[priority]))
+        ready_mask[priority / 32] &= ~(1u << (priority % 32));
+    ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or -1 if
+ there is none.  Interrupts must be off. */
+static int ready_max_priority(void) {
+    int i;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    for (i = READY_WORDS - 1; i >= 0; i--)
+        if (ready_mask[i] != 0)
+            return i * 32 + 31 - __builtin_clz(ready_mask[i]);
+    return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -789,11 +1027,48 @@ static void schedule(void) {
     ASSERT(cur->status != THREAD_RUNNING);
     ASSERT(is_thread(next));
 
-    if (cur != next)
+    if (cur != next) {
+        enum sched_switch_reason reason;
+
+        if (cur->status == THREAD_DYING)
+            reason = SWITCH_EXIT;
+        else if (cur->status == THREAD_BLOCKED)
+            reason = SWITCH_BLOCK;
+        else
+            reason = yield_reason;
+        trace_event(SCHED_SWITCH, cur, next, reason);
         prev = switch_threads(cur, next);
+    }
+    yield_reason = SWITCH_YIELD;
     thread_schedule_tail(prev);
 }
 
+/* Records an event of the given TYPE about thread T, involving
+ thread OTHER, which may be a null pointer, in the scheduler
+ trace, if it is enabled.  REASON is only meaningful for a
+ SCHED_SWITCH. */
+static void trace_event(enum sched_event_type type, struct thread *t,
+        struct thread *other, enum sched_switch_reason reason) {
+    enum intr_level old_level;
+    struct sched_event *ev;
+
+    if (trace == NULL)
+        return;
+
+    old_level = intr_disable();
+    ev = &trace[trace_next];
+    ev->time = timer_cycles();
+    ev->tid = t->tid;
+    ev->other = other != NULL ? other->tid : 0;
+    ev->type = type;
+    ev->reason = reason;
+    ev->priority = get_priority(t);
+    ev->other_priority = other != NULL ? get_priority(other) : 0;
+    trace_next = (trace_next + 1) % trace_size;
+    trace_cnt++;
+    intr_set_level(old_level);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t allocate_tid(void) {
     static tid_t next_tid = 1;
@@ -4,8 +4,11 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/synch.h"
 #include "vm/mmap.h"
 
+struct user_thread;
+
 /* States in a thread's life cycle. */
 enum thread_status {
     THREAD_RUNNING, /* Running thread. */
@@ -74,12 +77,10 @@ typedef int tid_t;
  the `magic' member of the running thread's `struct thread' is
  set to THREAD_MAGIC.  Stack overflow will normally change this
  value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
- the run queue (thread.c), or it can be an element in a
- semaphore wait list (synch.c).  It can be used these two ways
- only because they are mutually exclusive: only a thread in the
- ready state is on the run queue, whereas only a thread in the
- blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in a run queue (thread.c).
+ While a thread is blocked on a semaphore, its `wait_elem' is in
+ the semaphore's wait queue (synch.c), and `waitq' points to that
+ queue, so that the thread can be moved if its priority changes. */
 
 
 
@@ -91,20 +92,20 @@ struct thread {
     uint8_t *stack;                 /* Saved stack pointer. */
     int priority;                   /* Priority. */
     int donated_priority;           /* Donated priority. */
+    int ready_priority;             /* Ready queue, if THREAD_READY. */
     struct list_elem allelem;       /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;          /* List element. */
-
-    int sleep_time;                 /* Sleeping time of the thread*/
-    struct semaphore *semaphore;    /* Semaphore used to control the sleep of a thread*/
-    struct list_elem sleep_elem;    /* List element for sleep_thread_list*/
+    struct waitq_elem wait_elem;    /* Wait queue element. */
+    struct waitq *waitq;            /* Wait queue, if blocked on one. */
 
     struct lock *waiting_for_lock;  /* The lock that this thread is waiting for. */
     struct list donation_locks;     /* List of locks whose holder is this thread */
 
     int nice;                       /* Nice.*/
     int32_t recent_cpu;             /* Fixed-Point representation of Recent_cpu */
+    unsigned decay_seconds;         /* Decays applied to recent_cpu. */
 
 /* Owned by userprog/process.c. */
     uint32_t *pagedir;              /* Page directory. */
@@ -125,17 +126,34 @@ struct thread {
     int accu_mapid;
     struct list vm_mfiles;
 
+    /* The threads of a process use the fd table, supplemental page
+       table and mappings above of its main thread, which `process'
+       points to and which outlives the others.  Each has a copy of
+       `pagedir'.  Only main threads use `user_threads' and on. */
+    struct thread *process;         /* Main thread of our process. */
+    struct user_thread *user_thread;/* Join record, unless main thread. */
+    struct list user_threads;       /* Other threads' join records. */
+    struct lock process_lock;       /* Guards the fd table and threads. */
+    struct condition thread_exited; /* Signaled when a thread exits. */
+    int thread_cnt;                 /* Other threads still running. */
+    bool exiting;                   /* Whether the process is exiting. */
+
     /* Owned by thread.c. */
     unsigned magic; /* Detects stack overflow. */
 };
 
 /* File handler used to store the file descriptor
    and the corresponding opened file by the thread.
+   The threads of a process share its handlers, so each is
+   reference counted: the fd table holds one reference and each
+   system call using the file another, and the file is closed
+   when the last one is released.
 */
 
 struct file_handler {
     int fd; /* File descriptor. */
     struct file *file; /* Pointer to the file. */
+    int ref_cnt; /* References, guarded by process_lock. */
     struct list_elem elem;
 };
 
@@ -149,14 +167,13 @@ void thread_start(void);
 
 void thread_tick(void);
 
-void push_to_sleep_thread_list(struct list_elem *);
-void wake_threads(void);
-bool thread_compare(const struct list_elem *a, const struct list_elem *b,
-        void *aux);
 bool priority_compare(const struct list_elem *a, const struct list_elem *b,
         void *aux);
 
 void thread_print_stats(void);
+void thread_trace_init(size_t size);
+void thread_trace_priority(struct thread *, struct thread *donor);
+void thread_print_trace(void);
 
 typedef void thread_func(void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
@@ -170,6 +187,7 @@ const char *thread_name(void);
 
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_requeue(struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func(struct thread *t, void *aux);
@@ -177,6 +195,7 @@ void thread_foreach(thread_action_func *, void *);
 
 void thread_yield_safe(void);
 int thread_get_priority(void);
+int get_priority(struct thread *);
 void thread_set_priority(int);
 void thread_calc_priority(struct thread *, void *);
 
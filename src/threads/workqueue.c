@@ -0,0 +1,341 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Scheduled bottom halves.  Statically initialized, because
+   interrupts may schedule bottom halves before
+   workqueue_init(). */
+static struct list bh_list = LIST_INITIALIZER (bh_list);
+
+/* True while bh_run() is running bottom halves. */
+static bool bh_running;
+
+/* Number of worker threads. */
+#define WORKER_CNT 2
+
+/* Thread priority at which workers run items of each
+   priority. */
+static const int work_thread_priority[WORK_PRI_CNT] =
+  {
+    PRI_MAX,                    /* WORK_HIGH. */
+    PRI_DEFAULT,                /* WORK_NORMAL. */
+    PRI_MIN,                    /* WORK_LOW. */
+  };
+
+/* Queued work items, one list per priority.  Interrupts must be
+   off to use the queues, since items may be queued by interrupt
+   handlers. */
+static struct list queues[WORK_PRI_CNT];
+
+/* Upped once for each item queued.  A worker may find nothing to
+   run after downing it, if the item was cancelled meanwhile. */
+static struct semaphore work_available;
+
+/* Item that each worker is running, or a null pointer. */
+static struct work *running[WORKER_CNT];
+
+/* A thread in work_cancel_sync() waiting for a worker to finish
+   running WORK. */
+struct cancel_waiter
+  {
+    struct list_elem elem;      /* Element in CANCEL_WAITERS. */
+    const struct work *work;    /* Item being waited for. */
+    struct semaphore done;      /* Upped when WORK finishes. */
+  };
+
+/* Threads in work_cancel_sync().  Interrupts must be off to use
+   it. */
+static struct list cancel_waiters;
+
+static thread_func worker NO_RETURN;
+static void work_delay_over (void *work_);
+static bool work_running (const struct work *);
+
+/* Initializes a bottom half BH that calls FUNC with AUX.  The
+   bottom half is not scheduled. */
+void
+bh_init (struct bh *bh, bh_func *func, void *aux) 
+{
+  ASSERT (bh != NULL);
+  ASSERT (func != NULL);
+
+  bh->func = func;
+  bh->aux = aux;
+  bh->scheduled = false;
+}
+
+/* Schedules BH to run at the end of the current or next external
+   interrupt, unless it is already scheduled.  May be called from
+   an interrupt handler. */
+void
+bh_schedule (struct bh *bh) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (!bh->scheduled)
+    {
+      bh->scheduled = true;
+      list_push_back (&bh_list, &bh->elem);
+    }
+  intr_set_level (old_level);
+}
+
+/* Runs the scheduled bottom halves, including any scheduled
+   while they run, with interrupts on.  Called with interrupts
+   off by intr_handler() on the way out of an external interrupt,
+   and returns with interrupts off.  Does nothing if it interrupted
+   another bottom half, which goes on to run the new ones. */
+void
+bh_run (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_context ());
+
+  if (bh_running)
+    return;
+
+  bh_running = true;
+  while (!list_empty (&bh_list))
+    {
+      struct bh *bh = list_entry (list_pop_front (&bh_list), struct bh,
+                                  elem);
+      bh->scheduled = false;
+      intr_enable ();
+      bh->func (bh->aux);
+      intr_disable ();
+    }
+  bh_running = false;
+}
+
+/* Returns true if an interrupt arrived while bh_run() was
+   running a bottom half.  Such an interrupt must not switch
+   threads on its way out, or the bottom halves would stall until
+   the interrupted thread runs again. */
+bool
+bh_active (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return bh_running;
+}
+
+/* Initializes the work queue and starts the worker threads.
+   Must be called after thread_start(). */
+void
+workqueue_init (void) 
+{
+  int i;
+
+  for (i = 0; i < WORK_PRI_CNT; i++)
+    list_init (&queues[i]);
+  sema_init (&work_available, 0);
+  list_init (&cancel_waiters);
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "kworker/%d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, (void *) i)
+          == TID_ERROR)
+        PANIC ("cannot start %s", name);
+    }
+}
+
+/* Initializes WORK to call FUNC with AUX when it runs at
+   PRIORITY.  The item is not queued. */
+void
+work_init (struct work *work, work_func *func, void *aux,
+           enum work_priority priority) 
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+  ASSERT (priority >= 0 && priority < WORK_PRI_CNT);
+
+  work->func = func;
+  work->aux = aux;
+  work->priority = priority;
+  work->queued = false;
+  alarm_init (&work->alarm, work_delay_over, work);
+}
+
+/* Queues WORK to run as soon as a worker is free.  Returns true
+   if successful, false if WORK is already queued or delayed.
+   May be called from an interrupt handler. */
+bool
+work_queue (struct work *work) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = false;
+
+  if (!work->queued && !alarm_pending (&work->alarm))
+    {
+      work->queued = queued = true;
+      list_push_back (&queues[work->priority], &work->elem);
+      sema_up (&work_available);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues WORK once TICKS timer ticks have passed.  Returns true
+   if successful, false if WORK is already queued or delayed.
+   May be called from an interrupt handler. */
+bool
+work_queue_delayed (struct work *work, int64_t ticks) 
+{
+  enum intr_level old_level;
+  bool delayed = false;
+
+  if (ticks <= 0)
+    return work_queue (work);
+
+  old_level = intr_disable ();
+  if (!work->queued && !alarm_pending (&work->alarm))
+    {
+      alarm_set (&work->alarm, timer_ticks () + ticks);
+      delayed = true;
+    }
+  intr_set_level (old_level);
+  return delayed;
+}
+
+/* Alarm function that queues WORK_ once its delay is over. */
+static void
+work_delay_over (void *work_) 
+{
+  work_queue (work_);
+}
+
+/* Returns true if WORK is queued or delayed. */
+bool
+work_pending (const struct work *work) 
+{
+  return work->queued || alarm_pending (&work->alarm);
+}
+
+/* Cancels WORK if it is queued or delayed.  Returns true if it
+   was, false otherwise.  WORK may still be running when this
+   returns; see work_cancel_sync().  May be called from an
+   interrupt handler. */
+bool
+work_cancel (struct work *work) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool cancelled = alarm_cancel (&work->alarm);
+
+  if (work->queued)
+    {
+      list_remove (&work->elem);
+      work->queued = false;
+      sema_try_down (&work_available);
+      cancelled = true;
+    }
+  intr_set_level (old_level);
+  return cancelled;
+}
+
+/* Cancels WORK like work_cancel(), then waits until no worker is
+   running it, so that it may be freed.  WORK's function must not
+   queue it again.  Must not be called from WORK's own function,
+   which would wait for itself. */
+void
+work_cancel_sync (struct work *work) 
+{
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  work_cancel (work);
+  old_level = intr_disable ();
+  while (work_running (work))
+    {
+      struct cancel_waiter waiter;
+
+      waiter.work = work;
+      sema_init (&waiter.done, 0);
+      list_push_back (&cancel_waiters, &waiter.elem);
+      sema_down (&waiter.done);
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if a worker is running WORK.  Interrupts must be
+   off. */
+static bool
+work_running (const struct work *work) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < WORKER_CNT; i++)
+    if (running[i] == work)
+      return true;
+  return false;
+}
+
+/* Worker thread number ID_, which runs queued work items until
+   the kernel shuts down. */
+static void
+worker (void *id_) 
+{
+  int id = (int) id_;
+
+  for (;;)
+    {
+      struct work *work = NULL;
+      enum intr_level old_level;
+      struct list_elem *e;
+      work_func *func;
+      void *aux;
+      int priority;
+
+      /* Wait at the highest priority, so that a new item is
+         dequeued at once whatever the priority of the item that
+         ran last, and drop to the item's priority only then. */
+      thread_set_priority (PRI_MAX);
+      sema_down (&work_available);
+      old_level = intr_disable ();
+      for (priority = 0; priority < WORK_PRI_CNT; priority++)
+        if (!list_empty (&queues[priority]))
+          {
+            work = list_entry (list_pop_front (&queues[priority]),
+                               struct work, elem);
+            break;
+          }
+      if (work == NULL)
+        {
+          intr_set_level (old_level);
+          continue;
+        }
+      work->queued = false;
+      running[id] = work;
+      func = work->func;
+      aux = work->aux;
+      intr_set_level (old_level);
+
+      /* WORK may be freed or queued again as soon as FUNC
+         starts, so don't touch it after that. */
+      thread_set_priority (work_thread_priority[priority]);
+      func (aux);
+
+      old_level = intr_disable ();
+      e = list_begin (&cancel_waiters);
+      while (e != list_end (&cancel_waiters))
+        {
+          struct cancel_waiter *waiter = list_entry (e, struct cancel_waiter,
+                                                     elem);
+          e = list_next (e);
+          if (waiter->work == running[id])
+            {
+              list_remove (&waiter->elem);
+              sema_up (&waiter->done);
+            }
+        }
+      running[id] = NULL;
+      intr_set_level (old_level);
+    }
+}
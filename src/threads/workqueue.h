@@ -0,0 +1,77 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Bottom halves.
+
+   An interrupt handler with work that need not be done with
+   interrupts off can schedule a bottom half to do it.  Scheduled
+   bottom halves run once the outermost external interrupt
+   handler returns, in the interrupted thread, with interrupts
+   on.  Like interrupt handlers, they must not sleep. */
+
+/* Function called to run a bottom half. */
+typedef void bh_func (void *aux);
+
+/* A bottom half.  Initialize with bh_init(); it must stay alive
+   while it is scheduled. */
+struct bh
+  {
+    struct list_elem elem;      /* Element in the scheduled list. */
+    bh_func *func;              /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+    bool scheduled;             /* Scheduled and not yet run? */
+  };
+
+void bh_init (struct bh *, bh_func *, void *aux);
+void bh_schedule (struct bh *);
+void bh_run (void);
+bool bh_active (void);
+
+/* Work queue.
+
+   Work items are run by a pool of kernel worker threads shared
+   by the whole kernel, in order of priority and then of
+   queuing.  Unlike bottom halves they may sleep.  Items may be
+   queued from interrupt handlers, either to run as soon as a
+   worker is free or after a delay in timer ticks. */
+
+/* Work priorities.  Workers run items at the thread priority
+   given in workqueue.c for each. */
+enum work_priority
+  {
+    WORK_HIGH,                  /* Latency-sensitive work. */
+    WORK_NORMAL,                /* Most work. */
+    WORK_LOW,                   /* Background work. */
+    WORK_PRI_CNT                /* Number of priorities. */
+  };
+
+/* Function called to run a work item. */
+typedef void work_func (void *aux);
+
+/* A work item.  Initialize with work_init(); it must stay alive
+   while it is queued or delayed.  Its function may free it, or
+   queue it again. */
+struct work
+  {
+    struct list_elem elem;      /* Element in a queue. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+    enum work_priority priority; /* Queue to run from. */
+    struct alarm alarm;         /* Goes off when a delay is over. */
+    bool queued;                /* In a queue? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux, enum work_priority);
+bool work_queue (struct work *);
+bool work_queue_delayed (struct work *, int64_t ticks);
+bool work_pending (const struct work *);
+bool work_cancel (struct work *);
+void work_cancel_sync (struct work *);
+
+#endif /* threads/workqueue.h */
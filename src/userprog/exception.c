@@ -5,6 +5,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "vm/page.h"
+#include "userprog/process.h"
 #include "userprog/syscall.h"
 #include "threads/vaddr.h"
 
@@ -85,6 +86,7 @@ static void kill(struct intr_frame *f) {
         printf("%s: dying due to interrupt %#04x (%s).\n", thread_name(),
                 f->vec_no, intr_name(f->vec_no));
         intr_dump_frame(f);
+        process_begin_exit();
         thread_exit();
 
     case SEL_KCSEG:
@@ -0,0 +1,172 @@
+#include "userprog/futex.h"
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
+
+/* Futexes ("fast user-space mutexes").
+
+ A futex is an int in user memory that user programs update with
+ atomic instructions, entering the kernel only to sleep until it
+ changes or to wake the threads sleeping on it.  See lib/user/synch.c
+ for the mutexes and condition variables built on them.
+
+ Sleeping threads are kept in a hash table keyed by the kernel
+ virtual address of the futex, which identifies the physical frame
+ that holds it and the offset within, so that every mapping of the
+ same memory finds the same sleepers.  Each sleeper pins the frame
+ that holds its futex until it wakes up, so that the frame cannot be
+ evicted and come back at a different address, which would hide the
+ sleepers from futex_wake(). */
+
+#define FUTEX_BUCKETS 64
+
+/* A thread sleeping on a futex. */
+struct futex_waiter {
+    int *kaddr;                 /* Futex, as a kernel address. */
+    struct thread *process;     /* Main thread of the sleeper's process. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+    struct list_elem elem;      /* Element in a futex bucket. */
+};
+
+static struct list buckets[FUTEX_BUCKETS];
+static struct lock futex_lock;
+
+/* Returns the hash bucket for futex KADDR. */
+static struct list *futex_bucket(const int *kaddr) {
+    return &buckets[hash_int((int) kaddr) % FUTEX_BUCKETS];
+}
+
+/* Returns the kernel address of the futex at user address UADDR in
+ the current process, or a null pointer if UADDR is not mapped.
+ If PIN is true, the frame that holds it is pinned; release it with
+ futex_unpin(). */
+static int *futex_kaddr(int *uaddr, bool pin) {
+    uint32_t *pd = thread_current()->pagedir;
+    int *kaddr;
+
+    for (;;) {
+        kaddr = pagedir_get_page(pd, uaddr);
+        if (kaddr == NULL || !pin)
+            return kaddr;
+#ifdef VM
+        /* The frame may have been evicted between the lookup and the
+         pin, so check that the pinned frame still holds UADDR. */
+        frame_pin(pg_round_down(kaddr));
+        if (pagedir_get_page(pd, uaddr) == kaddr)
+            return kaddr;
+        frame_unpin(pg_round_down(kaddr));
+#else
+        return kaddr;
+#endif
+    }
+}
+
+/* Releases the pin taken by futex_kaddr() on the frame of KADDR. */
+static void futex_unpin(int *kaddr) {
+#ifdef VM
+    frame_unpin(pg_round_down(kaddr));
+#else
+    (void) kaddr;
+#endif
+}
+
+/* Initializes the futex table. */
+void futex_init(void) {
+    int i;
+
+    lock_init(&futex_lock);
+    for (i = 0; i < FUTEX_BUCKETS; i++)
+        list_init(&buckets[i]);
+}
+
+/* Sleeps until woken by futex_wake() on the futex at user address
+ UADDR, unless the futex no longer holds EXPECTED, which is checked
+ atomically with starting to sleep so that no wake-up can be missed.
+ Return 0 after sleeping, or -1 if the futex did not hold EXPECTED,
+ is misaligned or unmapped, or if the process is exiting. */
+int futex_wait(int *uaddr, int expected) {
+    struct thread *process = thread_current()->process;
+    struct futex_waiter waiter;
+    int *kaddr;
+
+    if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+        return -1;
+    kaddr = futex_kaddr(uaddr, true);
+    if (kaddr == NULL)
+        return -1;
+
+    lock_acquire(&futex_lock);
+    if (*kaddr != expected || process->exiting) {
+        lock_release(&futex_lock);
+        futex_unpin(kaddr);
+        return -1;
+    }
+    waiter.kaddr = kaddr;
+    waiter.process = process;
+    sema_init(&waiter.sema, 0);
+    list_push_back(futex_bucket(kaddr), &waiter.elem);
+    lock_release(&futex_lock);
+
+    sema_down(&waiter.sema);
+    futex_unpin(kaddr);
+    return 0;
+}
+
+/* Wakes up to CNT threads sleeping on the futex at user address
+ UADDR, in the order they began to sleep. Return the number woken,
+ or -1 if the futex is misaligned or unmapped. */
+int futex_wake(int *uaddr, int cnt) {
+    struct list *bucket;
+    struct list_elem *e;
+    int woken = 0;
+    int *kaddr;
+
+    if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+        return -1;
+    kaddr = futex_kaddr(uaddr, false);
+    if (kaddr == NULL)
+        return -1;
+    bucket = futex_bucket(kaddr);
+
+    lock_acquire(&futex_lock);
+    for (e = list_begin(bucket); e != list_end(bucket) && woken < cnt;) {
+        struct futex_waiter *waiter = list_entry(e, struct futex_waiter,
+                elem);
+        e = list_next(e);
+        if (waiter->kaddr == kaddr) {
+            list_remove(&waiter->elem);
+            sema_up(&waiter->sema);
+            woken++;
+        }
+    }
+    lock_release(&futex_lock);
+
+    return woken;
+}
+
+/* Wakes every thread of PROCESS that is sleeping on a futex, so
+ that it can see that PROCESS is exiting. */
+void futex_wake_process(struct thread *process) {
+    struct list_elem *e;
+    int i;
+
+    lock_acquire(&futex_lock);
+    for (i = 0; i < FUTEX_BUCKETS; i++)
+        for (e = list_begin(&buckets[i]); e != list_end(&buckets[i]);) {
+            struct futex_waiter *waiter = list_entry(e, struct futex_waiter,
+                    elem);
+            e = list_next(e);
+            if (waiter->process == process) {
+                list_remove(&waiter->elem);
+                sema_up(&waiter->sema);
+            }
+        }
+    lock_release(&futex_lock);
+}
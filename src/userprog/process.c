@@ -5,8 +5,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -22,8 +24,40 @@
 #include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_thread NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
+/* User threads.
+
+   Every thread of a user process but the first runs on a stack of
+   its own, in one of THREAD_MAX slots of THREAD_STACK_SIZE bytes
+   each, laid out downward from the lowest address that the first
+   thread's stack may grow into.  Like the first thread's stack, it
+   starts out as one page and grows on demand.  Its pages stay
+   mapped when the thread exits, for the next thread to use the
+   slot. */
+
+#define THREAD_STACK_SIZE (64 * PGSIZE) /* Stack size, 256 kB. */
+#define THREAD_MAX 32                   /* Threads besides the first. */
+
+/* A user thread other than its process's first, as seen by
+   process_thread_join().  Kept on its process's `user_threads'
+   list until joined or until the process exits. */
+struct user_thread
+  {
+    tid_t tid;                  /* Thread identifier. */
+    struct thread *process;     /* Main thread of its process. */
+    int slot;                   /* User stack slot. */
+    void *stub;                 /* User function to start in. */
+    void *start;                /* First argument to STUB. */
+    void *arg;                  /* Second argument to STUB. */
+    struct semaphore started;   /* Upped once the creator is done. */
+    void *retval;               /* Value passed to thread_exit(). */
+    bool exited;                /* Whether the thread has exited. */
+    bool joined;                /* Whether a thread has joined it. */
+    struct list_elem elem;      /* Element in `user_threads'. */
+  };
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -101,6 +135,7 @@ static void start_process(void *file_name_) {
     cur->fd++;
     fh_p->fd = cur->fd;
     fh_p->file = file;
+    fh_p->ref_cnt = 1;
     list_push_back(&cur->file_handler_list, &fh_p->elem);
     success = load(name, &if_.eip, &if_.esp);
 
@@ -256,7 +291,42 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct thread *process = cur->process;
   uint32_t *pd;
+  int fd;
+
+  if (cur->user_thread != NULL)
+    {
+      /* Leave the address space before our process's main thread
+         can destroy it, then let it and our joiner know. */
+      cur->pagedir = NULL;
+      pagedir_activate (NULL);
+
+      lock_acquire (&process->process_lock);
+      cur->user_thread->exited = true;
+      process->thread_cnt--;
+      cond_broadcast (&process->thread_exited, &process->process_lock);
+      lock_release (&process->process_lock);
+      return;
+    }
+
+  if (cur->pagedir != NULL)
+    {
+      /* Stop the other threads and wait for them to exit before
+         tearing down what they share with us. */
+      process_begin_exit ();
+      lock_acquire (&cur->process_lock);
+      while (cur->thread_cnt > 0)
+        cond_wait (&cur->thread_exited, &cur->process_lock);
+      while (!list_empty (&cur->user_threads))
+        free (list_entry (list_pop_front (&cur->user_threads),
+                          struct user_thread, elem));
+      lock_release (&cur->process_lock);
+
+      /* Close all the files and free all the file handlers. */
+      for (fd = cur->fd; fd > 1; fd--)
+        close (fd);
+    }
 
   list_remove(&cur->child_list_elem);
   sema_up(cur->exit_sema);
@@ -296,6 +366,236 @@ process_activate (void)
   tss_update ();
 }
 
+/* Returns the top of user stack slot SLOT. */
+static uint8_t *
+stack_slot_top (int slot)
+{
+  return (uint8_t *) PHYS_BASE - STACK_LIMIT - slot * THREAD_STACK_SIZE;
+}
+
+/* Returns true if UPAGE lies in the part of the address space that
+   the running thread's user stack may grow into. */
+bool
+process_stack_contains (const void *upage)
+{
+  struct user_thread *ut = thread_current ()->user_thread;
+  const uint8_t *top = ut != NULL ? stack_slot_top (ut->slot) : PHYS_BASE;
+  size_t size = ut != NULL ? THREAD_STACK_SIZE : STACK_LIMIT;
+  const uint8_t *p = upage;
+
+  return p < top && (size_t) (top - p) <= size;
+}
+
+/* Starts a new thread in the current process that calls user
+   function STUB with START and ARG as its arguments.  STUB has no
+   return address, so it should pass the result of calling START
+   to thread_exit() instead of returning.  Returns the new thread's
+   tid, or TID_ERROR if the process is exiting, already has
+   THREAD_MAX other threads, or the thread cannot be created. */
+tid_t
+process_thread_create (void *stub, void *start, void *arg)
+{
+  struct thread *process = thread_current ()->process;
+  struct user_thread *ut;
+  struct list_elem *e;
+  struct thread *t;
+  uint32_t slots = 0;
+  tid_t tid;
+
+  ut = malloc (sizeof *ut);
+  if (ut == NULL)
+    return TID_ERROR;
+  ut->tid = TID_ERROR;
+  ut->process = process;
+  ut->stub = stub;
+  ut->start = start;
+  ut->arg = arg;
+  sema_init (&ut->started, 0);
+  ut->retval = NULL;
+  ut->exited = false;
+  ut->joined = false;
+
+  /* Claim the lowest free stack slot. */
+  lock_acquire (&process->process_lock);
+  for (e = list_begin (&process->user_threads);
+       e != list_end (&process->user_threads); e = list_next (e))
+    slots |= 1u << list_entry (e, struct user_thread, elem)->slot;
+  for (ut->slot = 0; ut->slot < THREAD_MAX; ut->slot++)
+    if ((slots & (1u << ut->slot)) == 0)
+      break;
+  if (process->exiting || ut->slot == THREAD_MAX)
+    {
+      lock_release (&process->process_lock);
+      free (ut);
+      return TID_ERROR;
+    }
+  list_push_back (&process->user_threads, &ut->elem);
+  process->thread_cnt++;
+  lock_release (&process->process_lock);
+
+  tid = thread_create (process->name, PRI_DEFAULT, start_thread, ut);
+
+  lock_acquire (&process->process_lock);
+  ut->tid = tid;
+  if (tid == TID_ERROR)
+    {
+      list_remove (&ut->elem);
+      process->thread_cnt--;
+      cond_broadcast (&process->thread_exited, &process->process_lock);
+    }
+  lock_release (&process->process_lock);
+  if (tid == TID_ERROR)
+    {
+      free (ut);
+      return TID_ERROR;
+    }
+
+  /* thread_create() made the new thread our child, but it belongs
+     to our process, not to us, so it must not be wait()ed for. */
+  t = get_child_thread (tid);
+  list_remove (&t->child_list_elem);
+  t->parent = NULL;
+  sema_up (&ut->started);
+  return tid;
+}
+
+/* A thread function that enters user thread UT_ in its
+   process's address space. */
+static void
+start_thread (void *ut_)
+{
+  struct user_thread *ut = ut_;
+  struct thread *cur = thread_current ();
+  uint32_t *esp = (uint32_t *) stack_slot_top (ut->slot);
+  struct intr_frame if_;
+
+  sema_down (&ut->started);
+  cur->process = ut->process;
+  cur->user_thread = ut;
+  cur->pagedir = ut->process->pagedir;
+  process_activate ();
+
+  /* Map the top page of the stack, unless an earlier thread in the
+     slot did, and push STUB's arguments and a null return
+     address. */
+  if (get_sup_page (esp - 1) == NULL && !stack_growth (esp - 1))
+    thread_exit ();
+  *--esp = (uint32_t) ut->arg;
+  *--esp = (uint32_t) ut->start;
+  *--esp = 0;
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = (void (*) (void)) ut->stub;
+  if_.esp = esp;
+
+  /* Jump to user mode the same way start_process() does. */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for thread TID of the current process to exit and, if
+   RETVAL is nonnull, stores the value it passed to thread_exit()
+   in *RETVAL, which must be in kernel memory: a user page could
+   be evicted while this sleeps.  Returns 0 if successful, or -1 if TID is not
+   another thread of this process, if a thread has already joined
+   it, or if the process begins to exit in the meantime.  A
+   process's first thread cannot be joined. */
+int
+process_thread_join (tid_t tid, void **retval)
+{
+  struct thread *cur = thread_current ();
+  struct thread *process = cur->process;
+  struct user_thread *ut = NULL;
+  struct list_elem *e;
+  int result = -1;
+
+  lock_acquire (&process->process_lock);
+  for (e = list_begin (&process->user_threads);
+       e != list_end (&process->user_threads); e = list_next (e))
+    if (list_entry (e, struct user_thread, elem)->tid == tid)
+      ut = list_entry (e, struct user_thread, elem);
+
+  if (ut != NULL && ut != cur->user_thread && !ut->joined)
+    {
+      ut->joined = true;
+      while (!ut->exited && !process->exiting)
+        cond_wait (&process->thread_exited, &process->process_lock);
+      if (ut->exited)
+        {
+          if (retval != NULL)
+            *retval = ut->retval;
+          list_remove (&ut->elem);
+          free (ut);
+          result = 0;
+        }
+    }
+  lock_release (&process->process_lock);
+  return result;
+}
+
+/* Terminates the running thread, leaving RETVAL for
+   process_thread_join().  In a process's first thread, instead
+   waits for the other threads to exit and then exits the process
+   with status 0. */
+void
+process_thread_exit (void *retval)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->user_thread == NULL)
+    {
+      lock_acquire (&cur->process_lock);
+      while (cur->thread_cnt > 0 && !cur->exiting)
+        cond_wait (&cur->thread_exited, &cur->process_lock);
+      lock_release (&cur->process_lock);
+      exit (0);
+      NOT_REACHED ();
+    }
+
+  cur->user_thread->retval = retval;
+  thread_exit ();
+}
+
+/* Marks the current process as exiting, so that each of its
+   threads terminates the next time it returns to user mode, and
+   wakes those that are blocked in process_thread_join() or
+   futex_wait().  Returns false if the process was already
+   exiting. */
+bool
+process_begin_exit (void)
+{
+  struct thread *process = thread_current ()->process;
+  bool first;
+
+  lock_acquire (&process->process_lock);
+  first = !process->exiting;
+  process->exiting = true;
+  cond_broadcast (&process->thread_exited, &process->process_lock);
+  lock_release (&process->process_lock);
+
+  if (first)
+    futex_wake_process (process);
+  return first;
+}
+
+/* Terminates the running thread if it belongs to a user process
+   that is exiting.  Called on the way back to user mode, where
+   the thread holds no locks. */
+void
+process_check_exit (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->pagedir != NULL && cur->process->exiting)
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+}
+
 /* We load ELF binaries.  The following definitions are taken
    from the ELF specification, [ELF1], more-or-less verbatim.  */
 
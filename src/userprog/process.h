@@ -10,5 +10,12 @@ void process_exit (void);
 void process_activate (void);
 void* setup_esp(char *name, char **save, void *esp, int arglen);
 
+tid_t process_thread_create (void *stub, void *start, void *arg);
+int process_thread_join (tid_t, void **retval);
+void process_thread_exit (void *retval) NO_RETURN;
+bool process_begin_exit (void);
+void process_check_exit (void);
+bool process_stack_contains (const void *upage);
+
 
 #endif /* userprog/process.h */
@@ -1,16 +1,27 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
+#include <console.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include <stdbool.h>
 #include "vm/page.h"
+#include "threads/malloc.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 //number of system call types
-#define SYSCALL_NUM 13
+#define SYSCALL_NUM (SYS_THREAD_EXIT + 1)
 //maximum number of arguments of system calls
-#define MAX_ARGS_NUM 3
+#define MAX_ARGS_NUM 4
 //maximum buffer size per putbuf() operation
 #define MAX_PUTBUF_SIZE 512
 
@@ -26,11 +37,14 @@ static void syscall_handler(struct intr_frame *f);
 
 static int* syscall_get_args(struct intr_frame *f, int syscall_num);
 
+static void syscall_copy_out(void *udst, const void *src, size_t size);
+
 void syscall_init(void) {
 
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 
     lock_init(&filesys_lock);
+    futex_init();
 
     syscall_args_num[SYS_HALT] = 0;
     syscall_args_num[SYS_EXIT] = 1;
@@ -47,6 +61,20 @@ void syscall_init(void) {
     syscall_args_num[SYS_CLOSE] = 1;
     syscall_args_num[SYS_MMAP] = 2;
     syscall_args_num[SYS_MUNMAP] = 1;
+    syscall_args_num[SYS_PREAD] = 4;
+    syscall_args_num[SYS_PWRITE] = 4;
+    syscall_args_num[SYS_READV] = 3;
+    syscall_args_num[SYS_WRITEV] = 3;
+    syscall_args_num[SYS_COPY_FILE_RANGE] = 3;
+    syscall_args_num[SYS_FSYNC] = 1;
+    syscall_args_num[SYS_SYNC] = 0;
+    syscall_args_num[SYS_GETDENTS] = 3;
+    syscall_args_num[SYS_DMESG] = 2;
+    syscall_args_num[SYS_FUTEX_WAIT] = 2;
+    syscall_args_num[SYS_FUTEX_WAKE] = 2;
+    syscall_args_num[SYS_THREAD_CREATE] = 3;
+    syscall_args_num[SYS_THREAD_JOIN] = 2;
+    syscall_args_num[SYS_THREAD_EXIT] = 1;
 
 }
 
@@ -59,7 +87,7 @@ static void syscall_handler(struct intr_frame *f) {
 
     int syscall_num = *(int *) pagedir_get_page(t->pagedir, uaddr);
 
-    if (syscall_num < SYS_HALT || syscall_num > SYS_MUNMAP) {
+    if (syscall_num < SYS_HALT || syscall_num >= SYSCALL_NUM) {
         thread_exit();
     }
 
@@ -120,11 +148,73 @@ static void syscall_handler(struct intr_frame *f) {
     case SYS_MUNMAP:
         munmap((int) args[0]);
         break;
+    case SYS_PREAD:
+        f->eax = pread(args[0], (void *) args[1], (unsigned) args[2],
+                (unsigned) args[3]);
+        break;
+    case SYS_PWRITE:
+        f->eax = pwrite(args[0], (const void *) args[1], (unsigned) args[2],
+                (unsigned) args[3]);
+        break;
+    case SYS_READV:
+        f->eax = readv(args[0], (const struct iovec *) args[1], args[2]);
+        break;
+    case SYS_WRITEV:
+        f->eax = writev(args[0], (const struct iovec *) args[1], args[2]);
+        break;
+    case SYS_COPY_FILE_RANGE:
+        f->eax = copy_file_range(args[0], args[1], (unsigned) args[2]);
+        break;
+    case SYS_FSYNC:
+        f->eax = fsync(args[0]);
+        break;
+    case SYS_SYNC:
+        sync();
+        break;
+    case SYS_GETDENTS:
+        args[1] = syscall_get_kernel_ptr((const char *) args[1]);
+        f->eax = getdents(args[0], (void *) args[1], (unsigned) args[2]);
+        break;
+    case SYS_DMESG:
+        args[0] = syscall_get_kernel_ptr((const char *) args[0]);
+        f->eax = dmesg((char *) args[0], (unsigned) args[1]);
+        break;
+    case SYS_FUTEX_WAIT:
+        syscall_get_kernel_ptr((const int *) args[0]);
+        f->eax = futex_wait((int *) args[0], args[1]);
+        break;
+    case SYS_FUTEX_WAKE:
+        syscall_get_kernel_ptr((const int *) args[0]);
+        f->eax = futex_wake((int *) args[0], args[1]);
+        break;
+    case SYS_THREAD_CREATE:
+        check_ptr_in_user_memory((const void *) args[0]);
+        f->eax = process_thread_create((void *) args[0], (void *) args[1],
+                (void *) args[2]);
+        break;
+    case SYS_THREAD_JOIN: {
+        /* The join may sleep for long, so only translate the user
+           pointer once it is done. */
+        void *retval;
+        f->eax = process_thread_join(args[0], &retval);
+        if (f->eax == 0 && args[1] != 0) {
+            syscall_copy_out((void *) args[1], &retval, sizeof retval);
+        }
+        break;
+    }
+    case SYS_THREAD_EXIT: {
+        void *retval = (void *) args[0];
+        free(args);
+        process_thread_exit(retval);
+    }
     default:
         break;
     }
 
     free(args);
+
+    /* Another thread may have begun to exit the process meanwhile. */
+    process_check_exit();
 }
 
 int syscall_get_kernel_ptr(const void *vaddr) {
@@ -143,7 +233,7 @@ void check_ptr_in_user_memory(const void *vaddr) {
 }
 
 static int* syscall_get_args(struct intr_frame *f, int syscall_num) {
-    int *args = (int*) malloc(MAX_ARGS_NUM);
+    int *args = (int*) malloc(MAX_ARGS_NUM * sizeof(int));
     if (args == NULL) {
         PANIC("Allocation of memory of arguments fails.");
     }
@@ -192,20 +282,21 @@ void halt(void) {
 
 void exit(int status) {
 
-    struct thread *t = thread_current();
+    struct thread *t = thread_current()->process;
+
+    /* Only the first of a process's threads to exit it reports its
+       status.  process_exit() closes the process's files once all of
+       its threads are gone. */
+    if (!process_begin_exit()) {
+        thread_exit();
+    }
+
     printf("%s: exit(%d)\n", t->name, status);
     t->return_status = status;
     if (t->parent != NULL) {
         t->parent->return_status = status;
     }
 
-    /*Close all the files and free all the file handler*/
-    int fd = t->fd;
-    while (fd > 1) {
-        close(fd);
-        fd--;
-    }
-
     thread_exit();
 }
 
@@ -251,12 +342,13 @@ int read(int fd, const void *buffer, unsigned size) {
         return size;
     }
 
-    struct file *file = find_file(fd);
+    struct file_handler *fh = acquire_file(fd);
+    int read_size = -1;
 
-    if (file == NULL) {
-        return -1;
+    if (!inode_is_dir(file_get_inode(fh->file))) {
+        read_size = file_read(fh->file, buffer, size);
     }
-    int read_size = file_read(file, buffer, size);
+    release_file(fh);
     return read_size;
 }
 
@@ -282,18 +374,406 @@ int write(int fd, const void *buffer, unsigned size) {
         return written_size;
     } else {
 
-        struct file* file = find_file(fd);
+        struct file_handler *fh = acquire_file(fd);
+        int bytes = -1;
 
-        if (file == NULL) {
+        if (!inode_is_dir(file_get_inode(fh->file))) {
+            lock_acquire(&filesys_lock);
+            bytes = file_write(fh->file, buffer, size);
+            lock_release(&filesys_lock);
+        }
+        release_file(fh);
+
+        return bytes;
+    }
+}
+
+/* Most per-page segments of user buffers translated at a time. */
+#define SEG_MAX 16
+
+/* Return the kernel address of user address UADDR, or a null pointer if
+ it is not mapped in the user address space. */
+static void *syscall_translate(const void *uaddr) {
+
+    if (!is_user_vaddr(uaddr) || uaddr < CODE_SEGMENT_BOTTON) {
+        return NULL;
+    }
+    return pagedir_get_page(thread_current()->pagedir, uaddr);
+}
+
+/* Copy SIZE bytes from SRC to user address UDST a page at a time,
+ pinning each frame while it is written so that it cannot be evicted
+ between its translation and the store. Exit the process if a page is
+ not mapped. */
+static void syscall_copy_out(void *udst, const void *src, size_t size) {
+
+    uint8_t *dst = udst;
+    const uint8_t *from = src;
+
+    while (size > 0) {
+        uint8_t *kaddr = syscall_translate(dst);
+        size_t chunk = PGSIZE - pg_ofs(dst);
+
+        if (kaddr == NULL) {
             exit(-1);
         }
+#ifdef VM
+        /* The frame may have been evicted between the lookup and the
+         pin, so check that the pinned frame still holds DST. */
+        frame_pin(pg_round_down(kaddr));
+        if (syscall_translate(dst) != kaddr) {
+            frame_unpin(pg_round_down(kaddr));
+            continue;
+        }
+#endif
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy(kaddr, from, chunk);
+#ifdef VM
+        frame_unpin(pg_round_down(kaddr));
+#endif
+        dst += chunk;
+        from += chunk;
+        size -= chunk;
+    }
+}
+
+/* Translate the user buffers of the IOVCNT entries of IOV, starting *OFS
+ bytes into IOV[*IDX], into at most SEG_MAX kernel segments in SEG that
+ each lie within one page, and advance *IDX and *OFS past them. Store
+ their total length in *LEN. Return the number of segments, 0 once IOV
+ is used up, or -1 if a page of the buffers is not mapped. */
+static int syscall_get_segments(const struct iovec *iov, int iovcnt,
+        int *idx, size_t *ofs, struct iovec *seg, size_t *len) {
+
+    int cnt = 0;
+
+    *len = 0;
+    while (cnt < SEG_MAX && *idx < iovcnt) {
+        if (*ofs >= iov[*idx].iov_len) {
+            (*idx)++;
+            *ofs = 0;
+            continue;
+        }
+
+        const uint8_t *uaddr = (const uint8_t *) iov[*idx].iov_base + *ofs;
+        size_t size = iov[*idx].iov_len - *ofs;
+        size_t room = PGSIZE - pg_ofs(uaddr);
+        void *kaddr = syscall_translate(uaddr);
 
+        if (kaddr == NULL) {
+            return -1;
+        }
+        if (size > room) {
+            size = room;
+        }
+        seg[cnt].iov_base = kaddr;
+        seg[cnt].iov_len = size;
+        cnt++;
+        *ofs += size;
+        *len += size;
+    }
+    return cnt;
+}
+
+/* Read from FILE into the user buffers of the IOVCNT entries of IOV, or
+ write them to FILE if WRITING, a batch of pages at a time. Start at *POS
+ and leave the file position alone, or use the file position if POS is
+ null. Return the number of bytes transferred, or -1 if a page of the
+ buffers is not mapped. */
+static int syscall_file_iov(struct file *file, const struct iovec *iov,
+        int iovcnt, const off_t *pos, bool writing) {
+
+    struct iovec seg[SEG_MAX];
+    int idx = 0;
+    size_t ofs = 0;
+    size_t len;
+    int total = 0;
+    int cnt;
+
+    while ((cnt = syscall_get_segments(iov, iovcnt, &idx, &ofs, seg, &len))
+            > 0) {
+        off_t bytes;
+
+        if (writing) {
+            lock_acquire(&filesys_lock);
+            bytes = pos == NULL ? file_writev(file, seg, cnt) :
+                    file_writev_at(file, seg, cnt, *pos + total);
+            lock_release(&filesys_lock);
+        } else {
+            bytes = pos == NULL ? file_readv(file, seg, cnt) :
+                    file_readv_at(file, seg, cnt, *pos + total);
+        }
+        total += bytes;
+        if ((size_t) bytes < len) {
+            break;
+        }
+    }
+    return cnt < 0 ? -1 : total;
+}
+
+/* Transfer between the file with the given file descriptor and the user
+ buffers of IOV like syscall_file_iov(), unless it is a directory. Exit
+ the process if a page of the buffers is not mapped. */
+static int syscall_fd_iov(int fd, const struct iovec *iov, int iovcnt,
+        const off_t *pos, bool writing) {
+
+    struct file_handler *fh = acquire_file(fd);
+    int bytes = -1;
+
+    if (!inode_is_dir(file_get_inode(fh->file))) {
+        bytes = syscall_file_iov(fh->file, iov, iovcnt, pos, writing);
+        if (bytes < 0) {
+            release_file(fh);
+            exit(-1);
+        }
+    }
+    release_file(fh);
+
+    return bytes;
+}
+
+/* Read SIZE bytes from the file with the given file descriptor into
+ the user BUFFER, starting at OFFSET. The file position is left
+ unchanged, so concurrent readers sharing a descriptor do not race on
+ it. */
+int pread(int fd, void *buffer, unsigned size, unsigned offset) {
+
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO) {
+        return -1;
+    }
+
+    struct iovec iov = { buffer, size };
+    off_t pos = offset;
+
+    return syscall_fd_iov(fd, &iov, 1, &pos, false);
+}
+
+/* Write SIZE bytes from the user BUFFER to the file with the given file
+ descriptor, starting at OFFSET. The file position is left unchanged. */
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset) {
+
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO) {
+        return -1;
+    }
+
+    struct iovec iov = { (void *) buffer, size };
+    off_t pos = offset;
+
+    return syscall_fd_iov(fd, &iov, 1, &pos, true);
+}
+
+/* Copy the user iovec array IOV of IOVCNT entries into the kernel. The
+ buffers it describes stay in user memory; syscall_get_segments()
+ translates them. Return NULL if IOVCNT is out of range. The caller
+ must free the result. */
+static struct iovec *syscall_get_iovec(const struct iovec *iov, int iovcnt) {
+
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+        return NULL;
+    }
+
+    check_ptr_in_user_memory((const void *) iov);
+    check_ptr_in_user_memory((const void *) (iov + iovcnt) - 1);
+
+    struct iovec *kiov = (struct iovec *) malloc(iovcnt * sizeof *kiov);
+    if (kiov == NULL) {
+        PANIC("Allocation of memory of iovec fails.");
+    }
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        kiov[i].iov_base = *(void **) syscall_get_kernel_ptr(
+                &iov[i].iov_base);
+        kiov[i].iov_len = *(size_t *) syscall_get_kernel_ptr(
+                &iov[i].iov_len);
+    }
+    return kiov;
+}
+
+/* Read from the console into the user buffers of the IOVCNT entries of
+ IOV, or write them to the console if WRITING. Exit the process if a page
+ of the buffers is not mapped. */
+static int syscall_console_iov(const struct iovec *iov, int iovcnt,
+        bool writing) {
+
+    struct iovec seg[SEG_MAX];
+    int idx = 0;
+    size_t ofs = 0;
+    size_t len;
+    int total = 0;
+    int cnt;
+
+    while ((cnt = syscall_get_segments(iov, iovcnt, &idx, &ofs, seg, &len))
+            > 0) {
+        int i;
+        for (i = 0; i < cnt; i++) {
+            total += writing ?
+                    write(STDOUT_FILENO, seg[i].iov_base, seg[i].iov_len) :
+                    read(STDIN_FILENO, seg[i].iov_base, seg[i].iov_len);
+        }
+    }
+    if (cnt < 0) {
+        exit(-1);
+    }
+    return total;
+}
+
+/* Read from the file with the given file descriptor into the IOVCNT
+ buffers of IOV, in order, with a single pass over the file. Return
+ the number of bytes read, or -1 if IOVCNT is out of range. */
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+
+    if (fd == STDOUT_FILENO) {
+        return -1;
+    }
+
+    struct iovec *kiov = syscall_get_iovec(iov, iovcnt);
+    if (kiov == NULL) {
+        return -1;
+    }
+
+    int read_size;
+    if (fd == STDIN_FILENO) {
+        read_size = syscall_console_iov(kiov, iovcnt, false);
+    } else {
+        read_size = syscall_fd_iov(fd, kiov, iovcnt, NULL, false);
+    }
+
+    free(kiov);
+    return read_size;
+}
+
+/* Write the IOVCNT buffers of IOV, in order, to the file with the given
+ file descriptor with a single pass over the file. Return the number of
+ bytes written, or -1 if IOVCNT is out of range. */
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+
+    if (fd == STDIN_FILENO) {
+        return -1;
+    }
+
+    struct iovec *kiov = syscall_get_iovec(iov, iovcnt);
+    if (kiov == NULL) {
+        return -1;
+    }
+
+    int written_size;
+    if (fd == STDOUT_FILENO) {
+        written_size = syscall_console_iov(kiov, iovcnt, true);
+    } else {
+        written_size = syscall_fd_iov(fd, kiov, iovcnt, NULL, true);
+    }
+
+    free(kiov);
+    return written_size;
+}
+
+/* Copy up to SIZE bytes from the file FD_IN to the file FD_OUT, starting
+ at the current position of each and advancing both, without passing the
+ data through user memory. Return the number of bytes copied, or -1 if
+ either descriptor is a console or a directory or both refer to the same
+ file. */
+int copy_file_range(int fd_in, int fd_out, unsigned size) {
+
+    if (fd_in == STDIN_FILENO || fd_in == STDOUT_FILENO
+            || fd_out == STDIN_FILENO || fd_out == STDOUT_FILENO) {
+        return -1;
+    }
+
+    struct file_handler *in = acquire_file(fd_in);
+    struct file_handler *out = find_file_handler(fd_out);
+    int bytes = -1;
+
+    if (out == NULL) {
+        release_file(in);
+        exit(-1);
+    }
+    if (file_get_inode(in->file) != file_get_inode(out->file)
+            && !inode_is_dir(file_get_inode(in->file))
+            && !inode_is_dir(file_get_inode(out->file))) {
         lock_acquire(&filesys_lock);
-        int bytes = file_write(file, buffer, size);
+        bytes = file_copy(in->file, out->file, size);
         lock_release(&filesys_lock);
+    }
+    release_file(in);
+    release_file(out);
 
-        return bytes;
+    return bytes;
+}
+
+/* Write the buffered data and inode of the file with the given file
+ descriptor to disk. Return false for the console descriptors. */
+bool fsync(int fd) {
+
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO) {
+        return false;
+    }
+
+    struct file_handler *fh = acquire_file(fd);
+
+    lock_acquire(&filesys_lock);
+    file_sync(fh->file);
+    lock_release(&filesys_lock);
+    release_file(fh);
+
+    return true;
+}
+
+/* Write all buffered file system data to disk. */
+void sync(void) {
+
+    lock_acquire(&filesys_lock);
+    filesys_sync();
+    lock_release(&filesys_lock);
+}
+
+/* Fill BUFFER with as many packed directory entry records of the
+ directory open as FD as fit in SIZE bytes, continuing from where the
+ previous call stopped. Return the number of bytes filled, 0 at the end
+ of the directory, or -1 if FD is not a directory or BUFFER is too small
+ for the next entry. Only the buffer's first page is used. */
+int getdents(int fd, void *buffer, unsigned size) {
+
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO) {
+        return -1;
+    }
+
+    unsigned room = PGSIZE - pg_ofs(buffer);
+    if (size > room) {
+        size = room;
+    }
+
+    struct file_handler *fh = acquire_file(fd);
+    struct inode *inode = file_get_inode(fh->file);
+    int bytes = -1;
+
+    if (inode_is_dir(inode)) {
+        lock_acquire(&filesys_lock);
+        struct dir *dir = dir_open(inode_reopen(inode));
+        if (dir != NULL) {
+            dir_seek(dir, file_tell(fh->file));
+            bytes = dir_getdents(dir, buffer, size);
+            file_seek(fh->file, dir_tell(dir));
+            dir_close(dir);
+        }
+        lock_release(&filesys_lock);
     }
+    release_file(fh);
+
+    return bytes;
+}
+
+/* Copy as many of the most recent lines of the kernel log as fit
+ into the buffer, each prefixed by the time it was logged. Only the
+ buffer's first page is used. Return the number of bytes copied. */
+int dmesg(char *buffer, unsigned size) {
+
+    unsigned room = PGSIZE - pg_ofs(buffer);
+    if (size > room) {
+        size = room;
+    }
+    return console_read_log(buffer, size);
 }
 
 /* Remove the file with the given file path by calling the
@@ -328,17 +808,20 @@ int open(const char *file_path) {
 
     int fd = -1;
     if (file != NULL) {
-        struct thread *t = thread_current();
+        struct thread *t = thread_current()->process;
         struct file_handler *fh_p = (struct file_handler *) malloc(
                 sizeof(struct file_handler));
         if (fh_p == NULL) {
             PANIC("Allocation of memory of file handler fails.");
         }
+        lock_acquire(&t->process_lock);
         t->fd++;
         fh_p->fd = t->fd;
         fh_p->file = file;
+        fh_p->ref_cnt = 1;
         list_push_back(&t->file_handler_list, &fh_p->elem);
         fd = t->fd;
+        lock_release(&t->process_lock);
     }
 
     lock_release(&filesys_lock);
@@ -348,71 +831,108 @@ int open(const char *file_path) {
 /* Return the file size of a file with the given file descripter. */
 int filesize(int fd) {
 
-    struct file *file = find_file(fd);
-    if (file != NULL) {
-        return file_length(file);
-    }
-    return -1;
+    struct file_handler *fh = acquire_file(fd);
+    int size = file_length(fh->file);
+    release_file(fh);
+    return size;
 
 }
 
-/* Find the file with given file descripter in the file handler list
- by calling find_file_handler(). Return the file on success
- , otherwise return null.
+/* Find the file handler with given file descripter by calling
+ find_file_handler(), taking a reference to it that the caller must
+ drop with release_file(). Exit the process with -1 if there is none.
  */
-struct file *find_file(int fd) {
+struct file_handler *acquire_file(int fd) {
 
     struct file_handler *file_handler = find_file_handler(fd);
 
     if (file_handler != NULL) {
-        return file_handler->file;
+        return file_handler;
     }
     exit(-1);
 
 }
 
-/* Loop through the file_handler_list of the current thread and find
+/* Drop a reference taken by acquire_file() or find_file_handler().
+ Close the file and free the handler if it was the last one, that is,
+ if the descriptor has been closed meanwhile.
+ */
+void release_file(struct file_handler *file_handler) {
+
+    struct thread *t = thread_current()->process;
+
+    lock_acquire(&t->process_lock);
+    bool last = --file_handler->ref_cnt == 0;
+    lock_release(&t->process_lock);
+
+    if (last) {
+        lock_acquire(&filesys_lock);
+        file_close(file_handler->file);
+        lock_release(&filesys_lock);
+        free(file_handler);
+    }
+
+}
+
+/* Return the file handler with the given file descriptor in the
+ file_handler_list of the current process. Must be called with
+ process_lock held.
+ */
+static struct file_handler *lookup_file_handler(struct thread *process,
+        int fd) {
+
+    struct list_elem *e;
+
+    for (e = list_begin(&process->file_handler_list);
+            e != list_end(&process->file_handler_list); e = list_next(e)) {
+        struct file_handler *fh = list_entry(e, struct file_handler, elem);
+        if (fh->fd == fd) {
+            return fh;
+        }
+    }
+    return NULL;
+
+}
+
+/* Loop through the file_handler_list of the current process and find
  the file handler by comparing the file descriptor. Return the file
- handler on success, otherwise return null.
+ handler on success, with a reference taken that the caller must drop
+ with release_file(), otherwise return null.
  */
 struct file_handler *find_file_handler(int fd) {
 
-    struct list_elem *e;
-    struct thread *cur = thread_current();
+    struct thread *cur = thread_current()->process;
     struct file_handler *fh;
 
-    if (!list_empty(&cur->file_handler_list)) {
-        for (e = list_begin(&cur->file_handler_list);
-                e != list_end(&cur->file_handler_list); e = list_next(e)) {
-            fh = list_entry(e, struct file_handler, elem);
-            if (fh->fd == fd) {
-                return fh;
-            }
-        }
+    lock_acquire(&cur->process_lock);
+    fh = lookup_file_handler(cur, fd);
+    if (fh != NULL) {
+        fh->ref_cnt++;
     }
+    lock_release(&cur->process_lock);
 
-    return NULL;
+    return fh;
 
 }
 
-/*Find the file using file descriptor. Close the file by calling file_close()
- and remove the file handler from the list when successfully finding the file.
- Also free the file handler on success.
+/*Find the file using file descriptor and remove its file handler from
+ the list, dropping the list's reference. The file is closed, and the
+ handler freed, once no other thread is still using it.
  */
 void close(int fd) {
 
-    lock_acquire(&filesys_lock);
-    struct file_handler *file_handler = find_file_handler(fd);
+    struct thread *t = thread_current()->process;
+
+    lock_acquire(&t->process_lock);
+    struct file_handler *file_handler = lookup_file_handler(t, fd);
     if (file_handler != NULL) {
-        struct file *file = file_handler->file;
-        if (file != NULL) {
-            file_close(file);
-            list_remove(&file_handler->elem);
-            free(file_handler);
-        }
+        list_remove(&file_handler->elem);
     }
+    lock_release(&t->process_lock);
 
-    lock_release(&filesys_lock);
+    if (file_handler != NULL) {
+        release_file(file_handler);
+    }
 
 }
 
@@ -423,16 +943,11 @@ void close(int fd) {
 
 unsigned tell(int fd) {
 
-    lock_acquire(&filesys_lock);
-
-    struct file *file = find_file(fd);
-    if (file != NULL) {
+    struct file_handler *fh = acquire_file(fd);
+    unsigned position = file_tell(fh->file);
+    release_file(fh);
 
-        lock_release(&filesys_lock);
-        return file_tell(file);
-    }
-    lock_release(&filesys_lock);
-    exit(-1);
+    return position;
 
 }
 
@@ -442,16 +957,9 @@ unsigned tell(int fd) {
  */
 void seek(int fd, unsigned position) {
 
-    lock_acquire(&filesys_lock);
-
-    struct file *file = find_file(fd);
-    if (file != NULL) {
-
-        lock_release(&filesys_lock);
-        return file_seek(file, position);
-    }
-    lock_release(&filesys_lock);
-    exit(-1);
+    struct file_handler *fh = acquire_file(fd);
+    file_seek(fh->file, position);
+    release_file(fh);
 
 }
 
@@ -464,7 +972,11 @@ mapid_t mmap(int fd, void *addr) {
       reopen the file.
     */
     size_t size = filesize(fd);
-    struct file *file = file_reopen(find_file(fd));
+    struct file_handler *fh = acquire_file(fd);
+    lock_acquire(&filesys_lock);
+    struct file *file = file_reopen(fh->file);
+    lock_release(&filesys_lock);
+    release_file(fh);
 
     /*Checking if the file is NULL and the file size is less
       than an equal to 0. Return -1 when one of them is true.
@@ -528,9 +1040,11 @@ mapid_t mmap(int fd, void *addr) {
       this vm_mfile into the vm_mfiles list of the current thread.
     */
 
-    struct thread *current = thread_current();
+    struct thread *current = thread_current()->process;
+    lock_acquire(&current->process_lock);
     mapid_t mapid = current->accu_mapid + 1;
     current->accu_mapid = mapid;
+    lock_release(&current->process_lock);
 
     vm_add_mfile(mapid, fd, addr, end_addr);
 
@@ -1,6 +1,7 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 #include <stdbool.h>
+#include <uio.h>
 #include "filesys/filesys.h"
 #include "threads/synch.h"
 #include "vm/mmap.h"
@@ -26,6 +27,23 @@ int read(int fd, const void *buffer, unsigned size);
 
 int write(int fd, const void *buffer, unsigned size);
 
+int pread(int fd, void *buffer, unsigned size, unsigned offset);
+
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset);
+
+int readv(int fd, const struct iovec *iov, int iovcnt);
+
+int writev(int fd, const struct iovec *iov, int iovcnt);
+
+int copy_file_range(int fd_in, int fd_out, unsigned size);
+
+bool fsync(int fd);
+
+void sync(void);
+
+int getdents(int fd, void *buffer, unsigned size);
+int dmesg(char *buffer, unsigned size);
+
 bool create(const char *file_path, unsigned initial_size);
 
 bool remove(const char *file_path);
@@ -34,7 +52,9 @@ int open(const char *file_path);
 
 void close(int fd);
 
-struct file *find_file(int fd);
+struct file_handler *acquire_file(int fd);
+
+void release_file(struct file_handler *file_handler);
 
 struct file_handler *find_file_handler(int fd);
 
@@ -28,6 +28,7 @@ void *frame_get_page(enum palloc_flags flags, struct sup_page *upage) {
     }
     f->page = upage;
     f->thread = thread_current();
+    f->pin_cnt = 0;
     lock_acquire(&frame_lock);
     list_push_back(&frame_list, &f->frame_elem);
     lock_release(&frame_lock);
@@ -55,11 +56,54 @@ void frame_free_page(void *kpage) {
     return;
 }
 
-/*Evict a frame when no frame is available by using swap table*/
+/*Find the frame holding kpage in frame_list. Must be called with
+  frame_lock held. Return null if kpage is not a user frame.*/
+static struct frame *frame_lookup(void *kpage) {
+    struct list_elem *e;
+    for (e = list_begin(&frame_list); e != list_end(&frame_list);
+            e = list_next(e)) {
+        struct frame *f = list_entry(e, struct frame, frame_elem);
+        if (f->frame == kpage) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+/*Keep the frame kpage from being evicted until a matching
+  frame_unpin(). Pins nest. Does nothing if kpage is not a user frame.*/
+void frame_pin(void *kpage) {
+    lock_acquire(&frame_lock);
+    struct frame *f = frame_lookup(kpage);
+    if (f != NULL) {
+        f->pin_cnt++;
+    }
+    lock_release(&frame_lock);
+}
+
+/*Undo one frame_pin() of the frame kpage.*/
+void frame_unpin(void *kpage) {
+    lock_acquire(&frame_lock);
+    struct frame *f = frame_lookup(kpage);
+    if (f != NULL && f->pin_cnt > 0) {
+        f->pin_cnt--;
+    }
+    lock_release(&frame_lock);
+}
+
+/*Evict a frame when no frame is available by using swap table.
+  Pinned frames are skipped.*/
 void *frame_eviction(enum palloc_flags flags) {
     lock_acquire(&frame_lock);
-    struct frame *f = list_entry(list_begin(&frame_list), struct frame,
-            frame_elem);
+    struct list_elem *e = list_begin(&frame_list);
+    while (e != list_end(&frame_list)
+            && list_entry(e, struct frame, frame_elem)->pin_cnt > 0) {
+        e = list_next(e);
+    }
+    if (e == list_end(&frame_list)) {
+        PANIC("No unpinned frame to evict.");
+    }
+    struct frame *f = list_entry(e, struct frame, frame_elem);
 
     if (f->page->type == MMAP) {
         lock_acquire(&filesys_lock);
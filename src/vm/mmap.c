@@ -21,7 +21,7 @@ vm_add_mfile(mapid_t mapid, int fd, void *start_addr, void *end_addr) {
     mfile->fd = fd;
     mfile->start_addr = start_addr;
     mfile->end_addr = end_addr;
-    struct thread *current = thread_current();
+    struct thread *current = thread_current()->process;
     lock_acquire(&mfile_lock);
     list_insert_ordered(&current->vm_mfiles, &mfile->list_elem, mfile_compare, 0);
     lock_release(&mfile_lock);
@@ -34,7 +34,7 @@ struct vm_mfile*
 vm_find_mfile(mapid_t mapid) {
 
     struct vm_mfile *mfile;
-    struct thread *cur = thread_current();
+    struct thread *cur = thread_current()->process;
     struct list_elem *e;
     lock_acquire(&mfile_lock);
     if(!list_empty(&cur->vm_mfiles)) {
@@ -61,7 +61,7 @@ vm_delete_mfile(mapid_t mapid) {
         return false;
     }
 
-    struct thread *current = thread_current();
+    struct thread *current = thread_current()->process;
     lock_acquire(&mfile_lock);
     list_remove(&mfile->list_elem);
     free(mfile);
@@ -31,7 +31,7 @@ struct sup_page* init_sup_page(struct file *file, off_t ofs, uint8_t *upage,
     p->zero_bytes = zero_bytes;
     p->loaded = false;
     lock_acquire(&page_lock);
-    list_push_back(&thread_current()->sup_page_table, &p->page_elem);
+    list_push_back(&thread_current()->process->sup_page_table, &p->page_elem);
     lock_release(&page_lock);
     return p;
 }
@@ -43,7 +43,7 @@ struct sup_page* get_sup_page(void *addr) {
 
     lock_acquire(&page_lock);
     struct list_elem *e;
-    struct thread *cur = thread_current();
+    struct thread *cur = thread_current()->process;
 
     if (!list_empty(&cur->sup_page_table)) {
         for (e = list_begin(&cur->sup_page_table);
@@ -110,7 +110,7 @@ bool load_swap(struct sup_page *sup_page) {
 bool stack_growth(void *addr) {
     void *upage = pg_round_down(addr);
 
-    if ((size_t) (PHYS_BASE - upage <= STACK_LIMIT)) {
+    if (process_stack_contains(upage)) {
         struct sup_page *p = (struct sup_page *) malloc(
                 sizeof(struct sup_page));
         p->upage = upage;
@@ -125,7 +125,7 @@ bool stack_growth(void *addr) {
             return false;
         }
         lock_acquire(&page_lock);
-        list_push_back(&thread_current()->sup_page_table, &p->page_elem);
+        list_push_back(&thread_current()->process->sup_page_table, &p->page_elem);
         lock_release(&page_lock);
         return true;
     } else {
@@ -16,19 +16,11 @@ void init_swap(void) {
 
 size_t swap_write(void *frame) {
     size_t pos = bitmap_scan_and_flip(bitmap, 0, 1, 0);
-    size_t i;
-    for (i = 0; i < PAGE_BLOCKS; i++) {
-        block_write(bitmap, pos * PAGE_BLOCKS + i,
-                (uint8_t *) frame + i * (BLOCK_SECTOR_SIZE));
-    }
+    block_write_multiple(block, pos * PAGE_BLOCKS, PAGE_BLOCKS, frame);
     return pos;
 }
 
 void swap_read(void *frame, size_t pos) {
     bitmap_flip(bitmap, pos);
-    size_t i;
-    for (i = 0; i < PAGE_BLOCKS; i++) {
-        block_read(bitmap, pos * PAGE_BLOCKS + i,
-                (uint8_t *) frame + i * (BLOCK_SECTOR_SIZE));
-    }
+    block_read_multiple(block, pos * PAGE_BLOCKS, PAGE_BLOCKS, frame);
 }